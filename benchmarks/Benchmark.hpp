@@ -0,0 +1,44 @@
+#ifndef INC_BENCHMARK_HPP
+#define INC_BENCHMARK_HPP
+
+/**
+ * Small helpers shared by the benchmarks in this directory.
+ * Build and run them with "make gcc optimized omp bench".
+ */
+
+#include <sys/time.h> // gettimeofday()
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif // #ifdef _OPENMP
+
+#include "Memory.hpp"
+
+// **************************************************************
+inline double Wall_Time()
+/**
+ * Wall clock time, in seconds.
+ */
+{
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else // #ifdef _OPENMP
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return double(tv.tv_sec) + 1.0e-6 * double(tv.tv_usec);
+#endif // #ifdef _OPENMP
+}
+
+// **************************************************************
+inline int Max_Threads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else // #ifdef _OPENMP
+    return 1;
+#endif // #ifdef _OPENMP
+}
+
+#endif // INC_BENCHMARK_HPP
+
+// ********** End of file ***************************************
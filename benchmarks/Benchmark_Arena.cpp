@@ -0,0 +1,71 @@
+// **************************************************************
+//  Many short lived small buffers per "time step": per-call
+//  malloc_and_check()/free_me() compared to an Arena.
+// **************************************************************
+
+#include <cstdlib>
+
+#include "Benchmark.hpp"
+#include "Arena.hpp"
+
+const int nb_steps              = 1000;
+const int nb_buffers_per_step   = 10000;
+
+// Prevent the compiler from optimizing away the allocations.
+double * volatile sink;
+
+// **************************************************************
+int main()
+{
+    // Sizes (in number of doubles) of the buffers allocated every step.
+    int *sizes = malloc_and_check<int>(nb_buffers_per_step, "Benchmark_Arena");
+    double **buffers = malloc_and_check<double *>(nb_buffers_per_step, "Benchmark_Arena");
+    srand(42);
+    for (int b = 0 ; b < nb_buffers_per_step ; b++)
+        sizes[b] = 1 + rand() % 32;
+
+    double start = Wall_Time();
+    for (int step = 0 ; step < nb_steps ; step++)
+    {
+        for (int b = 0 ; b < nb_buffers_per_step ; b++)
+        {
+            buffers[b] = malloc_and_check<double>(sizes[b], "Benchmark_Arena");
+            sink = buffers[b];
+        }
+        for (int b = 0 ; b < nb_buffers_per_step ; b++)
+            free_me(buffers[b], sizes[b]);
+    }
+    const double per_call = (Wall_Time() - start) / (double(nb_steps) * double(nb_buffers_per_step)) * 1.0e9;
+
+    Arena arena(MiBytes_to_Bytes(1), "Benchmark_Arena");
+    start = Wall_Time();
+    for (int step = 0 ; step < nb_steps ; step++)
+    {
+        for (int b = 0 ; b < nb_buffers_per_step ; b++)
+        {
+            buffers[b] = arena.Allocate<double>(sizes[b]);
+            sink = buffers[b];
+        }
+        arena.Reset();
+    }
+    const double arena_call = (Wall_Time() - start) / (double(nb_steps) * double(nb_buffers_per_step)) * 1.0e9;
+
+    std_cout << "Buffers per step: " << nb_buffers_per_step << ", steps: " << nb_steps << "\n";
+    std_cout << "malloc_and_check + free_me:    " << per_call   << " ns per buffer\n";
+    std_cout << "Arena (Allocate + Reset):      " << arena_call << " ns per buffer\n";
+    arena.Print();
+
+    arena.Release();
+    free_me(sizes, nb_buffers_per_step);
+    free_me(buffers, nb_buffers_per_step);
+
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
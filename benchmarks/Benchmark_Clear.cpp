@@ -0,0 +1,79 @@
+// **************************************************************
+//  Time to get a zeroed block from calloc_and_check() against its
+//  size, with calloc() and with the parallel clear (non-temporal
+//  stores on all OpenMP threads). The blocks are malloc()ed, dirtied
+//  and freed first so that calloc() gets recycled memory that it
+//  must zero itself (disable glibc's mmap() of large blocks):
+//      make gcc optimized omp bench
+// **************************************************************
+
+#include <cstring>
+#include <malloc.h> // mallopt()
+
+#include "Benchmark.hpp"
+
+const int nb_repetitions = 5;
+
+// Prevent the compiler from optimizing away the allocations.
+char * volatile sink;
+
+// **************************************************************
+double Time_Calloc(const uint64_t bytes)
+/**
+ * Best time (seconds) of calloc_and_check() for "bytes" bytes.
+ */
+{
+    double best = 1.0e300;
+    for (int r = 0 ; r < nb_repetitions ; r++)
+    {
+        char *dirty = malloc_and_check<char>(bytes, "Benchmark_Clear");
+        memset(dirty, 0xFF, bytes);
+        free_me(dirty, bytes);
+
+        const double start = Wall_Time();
+        char *p = calloc_and_check<char>(bytes, "Benchmark_Clear");
+        const double time = Wall_Time() - start;
+        sink = p;
+        free_me(p, bytes);
+
+        if (time < best)
+            best = time;
+    }
+    return best;
+}
+
+// **************************************************************
+int main()
+{
+    // Keep large blocks on the heap so they are recycled.
+    mallopt(M_MMAP_THRESHOLD, 1 << 30);
+    mallopt(M_TRIM_THRESHOLD, 1 << 30);
+
+    std_cout << "Threads: " << Max_Threads() << "\n";
+    std_cout << "     MiB    calloc (ms)    parallel clear (ms)    Speedup\n";
+
+    for (uint64_t bytes = MiBytes_to_Bytes(1) ; bytes <= MiBytes_to_Bytes(512) ; bytes *= 4)
+    {
+        allocated_memory.Set_Parallel_Clear_Threshold(0);
+        const double serial = Time_Calloc(bytes);
+
+        allocated_memory.Set_Parallel_Clear_Threshold(1);
+        const double parallel = Time_Calloc(bytes);
+
+        std_cout.Format(8, 0, 'f');  std_cout << Bytes_to_MiBytes(bytes);
+        std_cout.Format(15, 3, 'f'); std_cout << serial * 1.0e3;
+        std_cout.Format(23, 3, 'f'); std_cout << parallel * 1.0e3;
+        std_cout.Format(11, 2, 'f'); std_cout << serial / parallel << "\n";
+    }
+    allocated_memory.Set_Parallel_Clear_Threshold(0);
+
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
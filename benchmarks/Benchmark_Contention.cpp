@@ -0,0 +1,67 @@
+// **************************************************************
+//  Throughput of malloc_and_check()/free_me() when many threads
+//  allocate at the same time (contention on "allocated_memory").
+// **************************************************************
+
+#include "Benchmark.hpp"
+
+const int nb_iterations = 2000000;   // Per thread
+const int nb_elements   = 16;
+
+// **************************************************************
+void Scale_Threads(const std::string &title)
+{
+    const int max_threads = Max_Threads();
+
+    std_cout << title << "\n";
+    std_cout << "Threads    Time (s)    Mallocs/s (total)    Mallocs/s (per thread)\n";
+
+    for (int nb_threads = 1 ; ; nb_threads *= 2)
+    {
+        if (nb_threads > max_threads)
+            nb_threads = max_threads;
+
+        const double start = Wall_Time();
+
+        #pragma omp parallel num_threads(nb_threads)
+        {
+            for (int i = 0 ; i < nb_iterations ; i++)
+            {
+                double *p = malloc_and_check<double>(nb_elements, "Benchmark_Contention");
+                free_me(p, nb_elements);
+            }
+        }
+
+        const double duration = Wall_Time() - start;
+        const double rate     = double(nb_threads) * double(nb_iterations) / duration;
+
+        std_cout.Format(7, 0, 'd');  std_cout << nb_threads;
+        std_cout.Format(12, 4, 'f'); std_cout << duration;
+        std_cout.Format(21, 4, 'g'); std_cout << rate;
+        std_cout.Format(26, 4, 'g'); std_cout << rate / double(nb_threads) << "\n";
+
+        if (nb_threads == max_threads)
+            break;
+    }
+}
+
+// **************************************************************
+int main()
+{
+    Scale_Threads("Shared atomic counter:");
+
+    allocated_memory.Enable_Sharded_Counters(MiBytes_to_Bytes(1));
+    Scale_Threads("Sharded counters (1 MiB slack):");
+    allocated_memory.Disable_Sharded_Counters();
+
+    // The accounting must be exact after all threads freed their memory.
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
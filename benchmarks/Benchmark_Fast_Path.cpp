@@ -0,0 +1,76 @@
+// **************************************************************
+//  Overhead of malloc_and_check()/free_me() (limit check,
+//  accounting, message) compared to raw malloc()/free(), for
+//  small allocations where it matters most.
+// **************************************************************
+
+#include <cstdlib>
+
+#include "Benchmark.hpp"
+
+const int nb_iterations = 10000000;
+
+// Prevent the compiler from optimizing away the allocations.
+double * volatile sink;
+
+// **************************************************************
+int main()
+{
+    allocated_memory.Set_Max_Bytes(GiBytes_to_Bytes(1.0));
+
+    const int nb = 4;
+
+    double start = Wall_Time();
+    for (int i = 0 ; i < nb_iterations ; i++)
+    {
+        double *p = static_cast<double *>(malloc(nb * sizeof(double)));
+        sink = p;
+        free(p);
+    }
+    const double raw = (Wall_Time() - start) / double(nb_iterations) * 1.0e9;
+
+    start = Wall_Time();
+    for (int i = 0 ; i < nb_iterations ; i++)
+    {
+        double *p = malloc_and_check<double>(nb, "A message longer than the small string buffer");
+        sink = p;
+        free_me(p, nb);
+    }
+    const double tracked = (Wall_Time() - start) / double(nb_iterations) * 1.0e9;
+
+    const std::string message("A message longer than the small string buffer");
+    start = Wall_Time();
+    for (int i = 0 ; i < nb_iterations ; i++)
+    {
+        double *p = malloc_and_check<double>(nb, message);
+        sink = p;
+        free_me(p, nb);
+    }
+    const double tracked_string = (Wall_Time() - start) / double(nb_iterations) * 1.0e9;
+
+    allocated_memory.Enable_Statistics();
+    start = Wall_Time();
+    for (int i = 0 ; i < nb_iterations ; i++)
+    {
+        double *p = malloc_and_check<double>(nb, "A message longer than the small string buffer");
+        sink = p;
+        free_me(p, nb);
+    }
+    const double tracked_statistics = (Wall_Time() - start) / double(nb_iterations) * 1.0e9;
+    allocated_memory.Disable_Statistics();
+
+    std_cout << "malloc + free:                               " << raw << " ns\n";
+    std_cout << "malloc_and_check + free_me (literal):        " << tracked << " ns (overhead: " << tracked - raw << " ns)\n";
+    std_cout << "malloc_and_check + free_me (std::string):    " << tracked_string << " ns (overhead: " << tracked_string - raw << " ns)\n";
+    std_cout << "malloc_and_check + free_me (statistics):     " << tracked_statistics << " ns (overhead: " << tracked_statistics - raw << " ns)\n";
+
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
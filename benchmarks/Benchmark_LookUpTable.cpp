@@ -0,0 +1,92 @@
+// **************************************************************
+//  LookUpTable: scalar read() loop against read_batch() (SIMD) and
+//  read_batch_parallel() (SIMD + OpenMP), for float and double, on
+//  a contiguous array of random points:
+//      make gcc optimized omp bench
+// **************************************************************
+
+#include <cmath>
+#include <cstdlib>
+
+#include "Benchmark.hpp"
+#include "LookUpTable.hpp"
+
+const int nb_points     = 1 << 22;
+const int nb_iterations = 20;
+
+// **************************************************************
+template <class Double>
+Double Exp_Minus(Double x)
+{
+    return Double(std::exp(-double(x)));
+}
+
+// **************************************************************
+template <class Double>
+void Benchmark(const std::string &type)
+{
+    LookUpTable<Double> lut(Exp_Minus<Double>, Double(0.0), Double(10.0), 10000, "Benchmark_LookUpTable");
+
+    Double *x   = malloc_and_check_aligned<Double>(nb_points, "Benchmark_LookUpTable");
+    Double *out = malloc_and_check_aligned<Double>(nb_points, "Benchmark_LookUpTable");
+    srand(42);
+    for (int i = 0 ; i < nb_points ; i++)
+        x[i] = Double(9.99) * Double(rand()) / Double(RAND_MAX);
+
+    double start = Wall_Time();
+    for (int it = 0 ; it < nb_iterations ; it++)
+    {
+        for (int i = 0 ; i < nb_points ; i++)
+            out[i] = lut.read(x[i]);
+    }
+    const double scalar = (Wall_Time() - start) / double(nb_iterations) / double(nb_points) * 1.0e9;
+    const Double checksum = out[nb_points/2];
+
+    start = Wall_Time();
+    for (int it = 0 ; it < nb_iterations ; it++)
+        lut.read_batch(x, out, nb_points);
+    const double batch = (Wall_Time() - start) / double(nb_iterations) / double(nb_points) * 1.0e9;
+
+    start = Wall_Time();
+    for (int it = 0 ; it < nb_iterations ; it++)
+        lut.read_batch_parallel(x, out, nb_points);
+    const double parallel = (Wall_Time() - start) / double(nb_iterations) / double(nb_points) * 1.0e9;
+
+    std_cout << type;
+    std_cout.Format(18, 3, 'f'); std_cout << scalar;
+    std_cout.Format(18, 3, 'f'); std_cout << batch;
+    std_cout.Format(18, 3, 'f'); std_cout << parallel;
+    std_cout.Format(12, 2, 'f'); std_cout << scalar / batch;
+    std_cout.Format(12, 2, 'f'); std_cout << scalar / parallel;
+    std_cout << (std::abs(double(out[nb_points/2] - checksum)) > 1.0e-5 ? "   MISMATCH" : "") << "\n";
+
+    free_me(x, nb_points);
+    free_me(out, nb_points);
+}
+
+// **************************************************************
+int main()
+{
+#if defined(__AVX512F__)
+    std_cout << "SIMD: AVX-512F";
+#elif defined(__AVX2__)
+    std_cout << "SIMD: AVX2";
+#else
+    std_cout << "SIMD: none (scalar fallback)";
+#endif // #if defined(__AVX512F__)
+    std_cout << ", threads: " << Max_Threads() << ", " << nb_points << " points\n";
+    std_cout << "Type      read() (ns/pt)  read_batch() (ns/pt)  parallel (ns/pt)    Speedup   Speedup (parallel)\n";
+
+    Benchmark<float>( "float ");
+    Benchmark<double>("double");
+
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
@@ -0,0 +1,100 @@
+// **************************************************************
+//  LookUpTable: values layout against the interleaved {value, slope}
+//  layout, with random and sequential access, on tables much larger
+//  than the L2 cache (4 Mi points), for float and double:
+//      make gcc optimized omp bench
+// **************************************************************
+
+#include <cmath>
+#include <cstdlib>
+
+#include "Benchmark.hpp"
+#include "LookUpTable.hpp"
+
+const int table_size    = 1 << 22;
+const int nb_points     = 1 << 22;
+const int nb_iterations = 5;
+
+// **************************************************************
+template <class Double>
+Double Sine(Double x)
+{
+    return Double(std::sin(double(x)));
+}
+
+// **************************************************************
+template <class Double>
+double Time_Read(LookUpTable<Double> &lut, const Double *x, Double *out, const bool batch)
+/**
+ * Nanoseconds per point.
+ */
+{
+    const double start = Wall_Time();
+    for (int it = 0 ; it < nb_iterations ; it++)
+    {
+        if (batch)
+            lut.read_batch(x, out, nb_points);
+        else
+        {
+            for (int i = 0 ; i < nb_points ; i++)
+                out[i] = lut.read(x[i]);
+        }
+    }
+    return (Wall_Time() - start) / double(nb_iterations) / double(nb_points) * 1.0e9;
+}
+
+// **************************************************************
+template <class Double>
+void Benchmark(const std::string &type)
+{
+    const Double xmax = Double(100.0);
+    LookUpTable<Double> values(Sine<Double>, Double(0.0), xmax, table_size, "Benchmark_LookUpTable_Layout");
+    LookUpTable<Double> pairs( Sine<Double>, Double(0.0), xmax, table_size, "Benchmark_LookUpTable_Layout", NULL, LUT_LAYOUT_INTERLEAVED);
+
+    Double *random     = malloc_and_check<Double>(nb_points, "Benchmark_LookUpTable_Layout");
+    Double *sequential = malloc_and_check<Double>(nb_points, "Benchmark_LookUpTable_Layout");
+    Double *out        = malloc_and_check<Double>(nb_points, "Benchmark_LookUpTable_Layout");
+    srand(42);
+    for (int i = 0 ; i < nb_points ; i++)
+    {
+        random[i]     = Double(0.999) * xmax * Double(rand()) / Double(RAND_MAX);
+        sequential[i] = Double(0.999) * xmax * Double(i) / Double(nb_points);
+    }
+
+    const Double *patterns[2]   = {random, sequential};
+    const char *pattern_names[2] = {"random    ", "sequential"};
+    for (int p = 0 ; p < 2 ; p++)
+    {
+        std_cout << type << "  " << pattern_names[p];
+        std_cout.Format(14, 3, 'f'); std_cout << Time_Read(values, patterns[p], out, false);
+        std_cout.Format(14, 3, 'f'); std_cout << Time_Read(pairs,  patterns[p], out, false);
+        std_cout.Format(14, 3, 'f'); std_cout << Time_Read(values, patterns[p], out, true);
+        std_cout.Format(14, 3, 'f'); std_cout << Time_Read(pairs,  patterns[p], out, true);
+        std_cout << "\n";
+    }
+
+    free_me(random, nb_points);
+    free_me(sequential, nb_points);
+    free_me(out, nb_points);
+}
+
+// **************************************************************
+int main()
+{
+    std_cout << "Table of " << table_size << " points, " << nb_points << " lookups (ns per lookup)\n";
+    std_cout << "                     read()        read()        read_batch()  read_batch()\n";
+    std_cout << "Type    Access       values        pairs         values        pairs\n";
+
+    Benchmark<float>( "float ");
+    Benchmark<double>("double");
+
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
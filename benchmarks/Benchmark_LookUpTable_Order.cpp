@@ -0,0 +1,93 @@
+// **************************************************************
+//  LookUpTable: accuracy and speed of a large linear table (10^6 points,
+//  8 MB in double: out of cache) against a small linear and a small
+//  cubic (Order 3) table (10^4 points), for exp(-x) on [0, 10] with
+//  random access:
+//      make gcc optimized omp bench
+// **************************************************************
+
+#include <cmath>
+#include <cstdlib>
+
+#include "Benchmark.hpp"
+#include "LookUpTable.hpp"
+
+const int nb_points     = 1 << 22;
+const int nb_iterations = 5;
+
+// **************************************************************
+template <class Double>
+Double Exp(Double x)
+{
+    return Double(std::exp(-double(x)));
+}
+
+// **************************************************************
+template <class Double, int Order>
+void Benchmark(const std::string &description, const int table_size, const Double *x, Double *out)
+{
+    LookUpTable<Double, Order> lut(Exp<Double>, Double(0.0), Double(10.0), table_size, "Benchmark_LookUpTable_Order");
+
+    double start = Wall_Time();
+    for (int it = 0 ; it < nb_iterations ; it++)
+        for (int i = 0 ; i < nb_points ; i++)
+            out[i] = lut.read(x[i]);
+    const double read_time = (Wall_Time() - start) / double(nb_iterations) / double(nb_points) * 1.0e9;
+
+    start = Wall_Time();
+    for (int it = 0 ; it < nb_iterations ; it++)
+        lut.read_batch(x, out, nb_points);
+    const double batch_time = (Wall_Time() - start) / double(nb_iterations) / double(nb_points) * 1.0e9;
+
+    double max_error = 0.0;
+    for (int i = 0 ; i < nb_points ; i++)
+    {
+        const double error = std::abs(double(out[i]) - std::exp(-double(x[i])));
+        if (error > max_error)
+            max_error = error;
+    }
+
+    std_cout << description;
+    std_cout.Format(14, 3, 'e'); std_cout << max_error;
+    std_cout.Format(14, 3, 'f'); std_cout << read_time;
+    std_cout.Format(14, 3, 'f'); std_cout << batch_time;
+    std_cout << "\n";
+}
+
+// **************************************************************
+template <class Double>
+void Benchmark(const std::string &type)
+{
+    Double *x   = malloc_and_check<Double>(nb_points, "Benchmark_LookUpTable_Order");
+    Double *out = malloc_and_check<Double>(nb_points, "Benchmark_LookUpTable_Order");
+    srand(42);
+    for (int i = 0 ; i < nb_points ; i++)
+        x[i] = Double(9.99) * Double(rand()) / Double(RAND_MAX);
+
+    Benchmark<Double, 1>(type + "  linear, 10^6 points", 1000000, x, out);
+    Benchmark<Double, 1>(type + "  linear, 10^4 points",   10000, x, out);
+    Benchmark<Double, 3>(type + "  cubic,  10^4 points",   10000, x, out);
+
+    free_me(x, nb_points);
+    free_me(out, nb_points);
+}
+
+// **************************************************************
+int main()
+{
+    std_cout << nb_points << " random lookups (ns per lookup)\n";
+    std_cout << "Type    Table                 Max error     read()        read_batch()\n";
+
+    Benchmark<float>( "float ");
+    Benchmark<double>("double");
+
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
@@ -0,0 +1,89 @@
+// **************************************************************
+//  LookUpTable against Segmented_LookUpTable (one uniform table per
+//  octave), both sized for the same relative error, for 1/r on
+//  [0.1, 100]: memory and random read() time.
+//      make gcc optimized omp bench
+// **************************************************************
+
+#include <cmath>
+#include <cstdlib>
+
+#include "Benchmark.hpp"
+#include "LookUpTable.hpp"
+#include "Segmented_LookUpTable.hpp"
+
+const int    nb_points          = 1 << 22;
+const int    nb_iterations      = 5;
+const double max_relative_error = 1.0e-8;
+
+// **************************************************************
+double Inverse(double r)
+{
+    return 1.0 / r;
+}
+
+// **************************************************************
+template <class Table>
+void Benchmark(const std::string &description, Table &lut, const double *x, double *out)
+{
+    const double start = Wall_Time();
+    for (int it = 0 ; it < nb_iterations ; it++)
+        for (int i = 0 ; i < nb_points ; i++)
+            out[i] = lut.read(x[i]);
+    const double read_time = (Wall_Time() - start) / double(nb_iterations) / double(nb_points) * 1.0e9;
+
+    double max_error = 0.0;
+    for (int i = 0 ; i < nb_points ; i++)
+    {
+        const double error = std::abs(out[i] * x[i] - 1.0);
+        if (error > max_error)
+            max_error = error;
+    }
+
+    std_cout << description;
+    std_cout.Format(12, 0, 'f'); std_cout << lut.Get_n();
+    std_cout.Format(14, 3, 'e'); std_cout << max_error;
+    std_cout.Format(14, 3, 'f'); std_cout << read_time;
+    std_cout << "\n";
+}
+
+// **************************************************************
+template <int Order>
+void Benchmark(const std::string &order, const double *x, double *out)
+{
+    LookUpTable<double, Order> uniform;
+    uniform.Initialize_To_Tolerance(Inverse, 0.1, 100.0, 0.0, max_relative_error, "Benchmark_LookUpTable_Segmented");
+    Segmented_LookUpTable<double, Order> segmented;
+    segmented.Initialize_To_Tolerance(Inverse, 0.1, 100.0, 0.0, max_relative_error, "Benchmark_LookUpTable_Segmented");
+
+    Benchmark(order + "  uniform  ", uniform,   x, out);
+    Benchmark(order + "  segmented", segmented, x, out);
+}
+
+// **************************************************************
+int main()
+{
+    double *x   = malloc_and_check<double>(nb_points, "Benchmark_LookUpTable_Segmented");
+    double *out = malloc_and_check<double>(nb_points, "Benchmark_LookUpTable_Segmented");
+    srand(42);
+    for (int i = 0 ; i < nb_points ; i++)
+        x[i] = 0.1 + 99.8 * double(rand()) / double(RAND_MAX);
+
+    std_cout << "1/r on [0.1, 100], relative error " << max_relative_error << ", " << nb_points << " random lookups\n";
+    std_cout << "Order   Table             Points   Max error     read() (ns)\n";
+    Benchmark<1>("linear", x, out);
+    Benchmark<3>("cubic ", x, out);
+
+    free_me(x, nb_points);
+    free_me(out, nb_points);
+
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
@@ -0,0 +1,64 @@
+// **************************************************************
+//  Per-allocation cost of malloc_and_check()/free_me() compared to
+//  raw malloc()/free(). Build once with and once without the size
+//  header to compare both paths:
+//      make gcc optimized bench
+//      make gcc optimized sizeheader bench
+// **************************************************************
+
+#include <cstdlib>
+
+#include "Benchmark.hpp"
+
+const int nb_iterations = 10000000;
+
+// Prevent the compiler from optimizing away the allocations.
+char * volatile sink;
+
+// **************************************************************
+int main()
+{
+#ifdef MEMORY_SIZE_HEADER
+    std_cout << "Size header: enabled (" << memory_header_size << " bytes per block)\n";
+#else // #ifdef MEMORY_SIZE_HEADER
+    std_cout << "Size header: disabled\n";
+#endif // #ifdef MEMORY_SIZE_HEADER
+
+    std_cout << "   Bytes    malloc+free (ns)    malloc_and_check+free_me (ns)    Overhead (ns)\n";
+
+    for (int nb = 8 ; nb <= 8192 ; nb *= 4)
+    {
+        double start = Wall_Time();
+        for (int i = 0 ; i < nb_iterations ; i++)
+        {
+            char *p = static_cast<char *>(malloc(nb));
+            sink = p;
+            free(p);
+        }
+        const double raw = (Wall_Time() - start) / double(nb_iterations) * 1.0e9;
+
+        start = Wall_Time();
+        for (int i = 0 ; i < nb_iterations ; i++)
+        {
+            char *p = malloc_and_check<char>(nb, "Benchmark_Size_Header");
+            sink = p;
+            free_me(p, nb);
+        }
+        const double tracked = (Wall_Time() - start) / double(nb_iterations) * 1.0e9;
+
+        std_cout.Format(8, 0, 'd');  std_cout << nb;
+        std_cout.Format(20, 2, 'f'); std_cout << raw;
+        std_cout.Format(33, 2, 'f'); std_cout << tracked;
+        std_cout.Format(17, 2, 'f'); std_cout << tracked - raw << "\n";
+    }
+
+    if (allocated_memory.Get_Bytes_Allocated() != 0)
+    {
+        std_cout << "ERROR: " << allocated_memory.Get_Bytes_Allocated() << " bytes still accounted for!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+// ********** End of file ***************************************
@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+# **************************************************************
+#  Summarize a memory trace written by Memory_Trace (src/Trace.hpp):
+#  peak usage, usage over time (in "--bins" time intervals) and the
+#  usage at every phase marker.
+#
+#  Usage: memory_trace_summary.py trace.csv [--bins 20] [--plot usage.png]
+# **************************************************************
+
+import argparse
+import csv
+import sys
+
+
+def human(nb_bytes):
+    for unit in ["B", "KiB", "MiB", "GiB"]:
+        if abs(nb_bytes) < 1024.0 or unit == "GiB":
+            return "%.3g %s" % (nb_bytes, unit)
+        nb_bytes /= 1024.0
+
+
+def read_trace(filename):
+    times, usages, phases = [], [], []
+    comments = []
+    with open(filename) as f:
+        for row in csv.reader(f):
+            if not row or row[0] == "time":
+                continue
+            if row[0].startswith("#"):
+                comments.append(",".join(row))
+                continue
+            time, usage = float(row[0]), int(row[2])
+            times.append(time)
+            usages.append(usage)
+            if len(row) > 4 and row[4] != "":
+                phases.append((time, usage, row[4]))
+    return times, usages, phases, comments
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Summarize a memory usage trace.")
+    parser.add_argument("trace", help="CSV trace written by Memory_Trace")
+    parser.add_argument("--bins", type=int, default=20, help="number of time intervals")
+    parser.add_argument("--plot", help="also plot the usage (and phases) to this image (needs matplotlib)")
+    args = parser.parse_args()
+
+    times, usages, phases, comments = read_trace(args.trace)
+    if not times:
+        sys.exit("Empty trace.")
+
+    duration = times[-1] - times[0]
+    peak = max(usages)
+    peak_time = times[usages.index(peak)]
+
+    print("Events:      %d" % len(times))
+    print("Duration:    %.6g s" % duration)
+    print("Peak usage:  %s at %.6g s" % (human(peak), peak_time))
+    print("Final usage: %s" % human(usages[-1]))
+    for comment in comments:
+        print(comment)
+
+    # Minimum, maximum and final usage in every time interval
+    print("")
+    print("%14s %14s %14s %14s" % ("Until (s)", "Min", "Max", "End"))
+    width = duration / args.bins if duration > 0.0 else 1.0
+    i = 0
+    current = usages[0]
+    for b in range(args.bins):
+        end = times[0] + (b + 1) * width
+        low = high = current
+        while i < len(times) and (times[i] <= end or b == args.bins - 1):
+            current = usages[i]
+            low, high = min(low, current), max(high, current)
+            i += 1
+        print("%14.6g %14s %14s %14s" % (end, human(low), human(high), human(current)))
+
+    if phases:
+        print("")
+        print("%14s %14s  %s" % ("Time (s)", "Usage", "Phase"))
+        for time, usage, name in phases:
+            print("%14.6g %14s  %s" % (time, human(usage), name))
+
+    if args.plot:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+        plt.step(times, [u / 1048576.0 for u in usages], where="post")
+        for time, usage, name in phases:
+            plt.axvline(time, color="grey", linestyle=":")
+            plt.text(time, peak / 1048576.0, name, rotation=90, va="top", fontsize="small")
+        plt.xlabel("Time (s)")
+        plt.ylabel("Usage (MiB)")
+        plt.savefig(args.plot)
+
+
+if __name__ == "__main__":
+    main()
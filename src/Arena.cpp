@@ -0,0 +1,159 @@
+// **************************************************************
+//              Bump allocator on top of the tracked allocator
+// **************************************************************
+
+#include "Arena.hpp"
+
+// **************************************************************
+Arena::Arena(const size_t _chunk_size, const std::string _name)
+{
+    name            = _name;
+    tag             = allocated_memory.Register_Tag(name);
+    chunk_size      = _chunk_size;
+    first           = NULL;
+    current         = NULL;
+    position        = NULL;
+    end             = NULL;
+    nb_allocations  = 0;
+}
+
+// **************************************************************
+Arena::~Arena()
+{
+    Release();
+}
+
+// **************************************************************
+void Arena::Use_Chunk(Arena_Chunk *chunk)
+{
+    current     = chunk;
+    position    = reinterpret_cast<char *>(chunk) + arena_chunk_header_size;
+    end         = reinterpret_cast<char *>(chunk) + chunk->size;
+}
+
+// **************************************************************
+void * Arena::Allocate_From_Next_Chunk(const size_t bytes, const size_t alignment)
+/**
+ * Slow path of Allocate_Bytes(): the current chunk is full. Move to the next
+ * chunk (still there after a Reset()) or get a new one from alloc_and_check().
+ * Returns NULL if the new chunk is refused (see Memory_Over_Limit_Policy).
+ */
+{
+    Arena_Chunk *next = (current == NULL ? first : current->next);
+
+    if (next == NULL)
+    {
+        size_t size = chunk_size;
+        const size_t needed = arena_chunk_header_size + bytes + alignment;
+        if (size < needed)
+            size = needed;
+
+        next = reinterpret_cast<Arena_Chunk *>(alloc_and_check<char>(size, false, name.c_str(), MEMORY_ALIGNMENT, tag.id));
+        // Refused (MEMORY_POLICY_RETURN_NULL): the arena is left unchanged.
+        if (next == NULL)
+            return NULL;
+        next->next = NULL;
+        next->size = size;
+
+        if (current == NULL)
+            first = next;
+        else
+            current->next = next;
+    }
+
+    Use_Chunk(next);
+
+    // If a re-used chunk is too small, this will move to the following one.
+    return Allocate_Bytes(bytes, alignment);
+}
+
+// **************************************************************
+void Arena::Reset()
+/**
+ * Forget all sub-allocations. The chunks are kept (and stay accounted
+ * for in "allocated_memory") to be re-used.
+ */
+{
+    if (first != NULL)
+        Use_Chunk(first);
+    nb_allocations = 0;
+}
+
+// **************************************************************
+void Arena::Release()
+/**
+ * Give back all chunks to the tracked allocator.
+ */
+{
+    Arena_Chunk *chunk = first;
+    while (chunk != NULL)
+    {
+        Arena_Chunk *next = chunk->next;
+        char *p = reinterpret_cast<char *>(chunk);
+        free_me(p, chunk->size, tag);
+        chunk = next;
+    }
+
+    first           = NULL;
+    current         = NULL;
+    position        = NULL;
+    end             = NULL;
+    nb_allocations  = 0;
+}
+
+// **************************************************************
+uint64_t Arena::Get_Bytes_Reserved()
+/**
+ * Bytes taken from the tracked allocator (what "allocated_memory" is charged).
+ */
+{
+    uint64_t bytes = 0;
+    for (Arena_Chunk *chunk = first ; chunk != NULL ; chunk = chunk->next)
+        bytes += chunk->size;
+    return bytes;
+}
+
+// **************************************************************
+uint64_t Arena::Get_Bytes_Used()
+/**
+ * Bytes handed out since the last Reset(), including alignment padding
+ * and the unused tails of the chunks already filled.
+ */
+{
+    if (current == NULL)
+        return 0;
+
+    uint64_t bytes = 0;
+    for (Arena_Chunk *chunk = first ; chunk != current ; chunk = chunk->next)
+        bytes += chunk->size - arena_chunk_header_size;
+    bytes += uint64_t(position - (reinterpret_cast<char *>(current) + arena_chunk_header_size));
+    return bytes;
+}
+
+// **************************************************************
+int Arena::Get_Nb_Chunks()
+{
+    int nb = 0;
+    for (Arena_Chunk *chunk = first ; chunk != NULL ; chunk = chunk->next)
+        nb++;
+    return nb;
+}
+
+// **************************************************************
+size_t Arena::Get_Nb_Allocations()
+{
+    return nb_allocations;
+}
+
+// **************************************************************
+void Arena::Print()
+{
+    std_cout.Clear_Format();
+    std_cout << "Arena \"" << name << "\":\n";
+    std_cout << "    Chunks:             " << Get_Nb_Chunks() << "\n";
+    std_cout << "    Reserved:           " << Bytes_in_String(Get_Bytes_Reserved()) << "\n";
+    std_cout << "    Used:               " << Bytes_in_String(Get_Bytes_Used()) << "\n";
+    std_cout << "    Allocations:        " << Get_Nb_Allocations() << "\n";
+}
+
+// ********** End of file ***************************************
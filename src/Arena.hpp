@@ -0,0 +1,89 @@
+#ifndef INC_ARENA_HPP
+#define INC_ARENA_HPP
+
+#include <string>
+
+#include "Memory.hpp"
+
+// **************************************************************
+// Header at the start of every chunk of an arena, followed by the data.
+struct Arena_Chunk
+{
+    Arena_Chunk *next;  // Next chunk in the arena (NULL for the last one)
+    size_t       size;  // Total size of the chunk, header included
+};
+
+// Space used by the chunk's header, rounded to keep the data aligned.
+const size_t arena_chunk_header_size = 64;
+
+// **************************************************************
+class Arena
+/**
+ * Bump allocator for short lived buffers. Memory is taken from the tracked
+ * allocator (alloc_and_check()) by large chunks, so "allocated_memory" is
+ * charged once per chunk instead of once per buffer. Buffers are never freed
+ * individually: Reset() makes all of them available again at once (for
+ * example at the end of a time step) while keeping the chunks for re-use,
+ * and Release() gives the chunks back.
+ */
+{
+    private:
+        std::string  name;
+        Memory_Tag   tag;           // Chunks are accounted for under the arena's name
+        size_t       chunk_size;    // Default size of a new chunk (bytes)
+        Arena_Chunk *first;         // First chunk of the list
+        Arena_Chunk *current;       // Chunk sub-allocations are taken from
+        char        *position;      // Next free byte in the current chunk
+        char        *end;           // One past the last byte of the current chunk
+        size_t       nb_allocations;
+
+        void *      Allocate_From_Next_Chunk(const size_t bytes, const size_t alignment);
+        void        Use_Chunk(Arena_Chunk *chunk);
+
+        // Not copyable
+        Arena(const Arena &other);
+        Arena & operator=(const Arena &other);
+
+    public:
+        Arena(const size_t _chunk_size = 1048576, const std::string _name = "Arena");
+        ~Arena();
+
+        // **************************************************************
+        inline void * Allocate_Bytes(const size_t bytes, const size_t alignment = 16)
+        /**
+         * Returns "bytes" bytes aligned on "alignment" (a power of two), or
+         * NULL if a new chunk was needed and refused (MEMORY_POLICY_RETURN_NULL).
+         * Fast path: only a pointer bump.
+         */
+        {
+            char *p = (char *) ((uintptr_t(position) + (alignment - 1)) & ~uintptr_t(alignment - 1));
+            if (p + bytes <= end)
+            {
+                position = p + bytes;
+                nb_allocations++;
+                return p;
+            }
+            return Allocate_From_Next_Chunk(bytes, alignment);
+        }
+
+        // **************************************************************
+        template <class T>
+        inline T * Allocate(const size_t nb, const size_t alignment = 16)
+        {
+            return static_cast<T *>(Allocate_Bytes(nb * sizeof(T), alignment));
+        }
+
+        void        Reset();
+        void        Release();
+
+        uint64_t    Get_Bytes_Reserved();
+        uint64_t    Get_Bytes_Used();
+        int         Get_Nb_Chunks();
+        size_t      Get_Nb_Allocations();
+
+        void        Print();
+};
+
+#endif // INC_ARENA_HPP
+
+// ********** End of file ***************************************
@@ -0,0 +1,103 @@
+// **************************************************************
+//              Parallel zeroing of large cleared blocks
+// **************************************************************
+
+#include <cstring>  // memset()
+
+#ifdef __SSE2__
+#include <emmintrin.h>  // _mm_stream_si128(), _mm_sfence()
+#endif // #ifdef __SSE2__
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif // #ifdef _OPENMP
+
+#include "Memory.hpp"
+
+uint64_t memory_parallel_clear_threshold = MEMORY_PARALLEL_CLEAR_THRESHOLD;
+
+// **************************************************************
+static void Stream_Zero(char *begin, char *end)
+/**
+ * Zero [begin, end) with non-temporal stores: the zeros go straight to
+ * memory instead of evicting the whole cache (the block is much larger
+ * than it anyway).
+ */
+{
+#ifdef __SSE2__
+    // Unaligned head
+    char *aligned = (char *) ((uintptr_t(begin) + 15) & ~uintptr_t(15));
+    if (aligned > end)
+        aligned = end;
+    memset(begin, 0, aligned - begin);
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i *p = (__m128i *) aligned;
+    __m128i *last = (__m128i *) (uintptr_t(end) & ~uintptr_t(15));
+    for ( ; p + 4 <= last ; p += 4)
+    {
+        _mm_stream_si128(p,     zero);
+        _mm_stream_si128(p + 1, zero);
+        _mm_stream_si128(p + 2, zero);
+        _mm_stream_si128(p + 3, zero);
+    }
+    for ( ; p < last ; p++)
+        _mm_stream_si128(p, zero);
+    // Streaming stores are weakly ordered: make them visible before returning.
+    _mm_sfence();
+
+    // Tail
+    memset((char *) p, 0, end - (char *) p);
+#else // #ifdef __SSE2__
+    memset(begin, 0, end - begin);
+#endif // #ifdef __SSE2__
+}
+
+// **************************************************************
+void Memory_Parallel_Clear(void *p, const size_t bytes)
+/**
+ * Zero "bytes" bytes at "p" using all OpenMP threads, each one a contiguous
+ * range of whole pages (so on NUMA machines, newly touched pages land near
+ * the thread that will use the same schedule(static) chunk).
+ */
+{
+    char *begin = static_cast<char *>(p);
+    const size_t nb_pages = (bytes + memory_page_size - 1) / memory_page_size;
+
+    #pragma omp parallel
+    {
+#ifdef _OPENMP
+        const size_t nb_threads = size_t(omp_get_num_threads());
+        const size_t thread     = size_t(omp_get_thread_num());
+#else // #ifdef _OPENMP
+        const size_t nb_threads = 1;
+        const size_t thread     = 0;
+#endif // #ifdef _OPENMP
+        const size_t chunk = (nb_pages + nb_threads - 1) / nb_threads;
+        const size_t first = (thread * chunk * memory_page_size < bytes ? thread * chunk * memory_page_size : bytes);
+        const size_t last  = (first + chunk * memory_page_size < bytes ? first + chunk * memory_page_size : bytes);
+        Stream_Zero(begin + first, begin + last);
+    }
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Parallel_Clear_Threshold(const uint64_t bytes)
+/**
+ * Cleared allocations (calloc_and_check() & co.) of at least "bytes" bytes
+ * (0: none) will be zeroed by all OpenMP threads with non-temporal stores.
+ * Worth it when calloc() has to zero recycled heap memory itself, for
+ * blocks much larger than the caches. Blocks mmap()ed (see
+ * Set_Mmap_Threshold()) come zeroed from the kernel and are not affected.
+ * Default: MEMORY_PARALLEL_CLEAR_THRESHOLD (0, can be set at compile time).
+ */
+{
+    memory_parallel_clear_threshold = bytes;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Parallel_Clear_Threshold()
+{
+    return memory_parallel_clear_threshold;
+}
+
+// ********** End of file ***************************************
@@ -0,0 +1,119 @@
+#ifndef INC_GROWABLE_ARRAY_HPP
+#define INC_GROWABLE_ARRAY_HPP
+
+#include <string>
+
+#include "Memory.hpp"
+
+// **************************************************************
+template <class T>
+class Growable_Array
+/**
+ * Tracked array that grows by doubling its capacity (amortized constant
+ * time Push_Back()), using realloc_and_check(): no temporary second copy
+ * when it grows and, once large enough to be mmap()ed, no copy at all.
+ * Like malloc_and_check(), elements are raw memory: only for plain data
+ * types (no constructors or destructors are called).
+ * Not thread safe.
+ */
+{
+    private:
+    std::string name;
+    Memory_Tag  tag;        // Accounted for under the array's name
+    T          *data;
+    uint64_t    size;
+    uint64_t    capacity;
+
+    // Not copyable
+    Growable_Array(const Growable_Array &other);
+    Growable_Array & operator=(const Growable_Array &other);
+
+    public:
+    // **************************************************************
+    Growable_Array(const std::string _name = "Growable_Array", const uint64_t initial_capacity = 0)
+    {
+        name     = _name;
+        tag      = allocated_memory.Register_Tag(name);
+        data     = NULL;
+        size     = 0;
+        capacity = 0;
+        Reserve(initial_capacity);
+    }
+
+    // **************************************************************
+    ~Growable_Array()
+    {
+        free_me(data, capacity, tag);
+    }
+
+    // **************************************************************
+    bool Reserve(const uint64_t new_capacity)
+    /**
+     * Make room for at least "new_capacity" elements. Returns false if the
+     * growth was refused (see Memory_Over_Limit_Policy); the array is then
+     * unchanged.
+     */
+    {
+        if (new_capacity <= capacity)
+            return true;
+        T *new_data = realloc_and_check(data, capacity, new_capacity, name.c_str(), tag);
+        if (new_data == NULL)
+            return false;
+        data     = new_data;
+        capacity = new_capacity;
+        return true;
+    }
+
+    // **************************************************************
+    inline bool Push_Back(const T &value)
+    {
+        if (MEMORY_UNLIKELY(size == capacity) && !Reserve(capacity < 8 ? 8 : 2 * capacity))
+            return false;
+        data[size++] = value;
+        return true;
+    }
+
+    // **************************************************************
+    bool Resize(const uint64_t new_size)
+    /**
+     * New elements (if growing) are not initialized.
+     */
+    {
+        if (new_size > capacity && !Reserve(new_size > 2 * capacity ? new_size : 2 * capacity))
+            return false;
+        size = new_size;
+        return true;
+    }
+
+    // **************************************************************
+    void Shrink_To_Fit()
+    /**
+     * Give back the unused capacity.
+     */
+    {
+        if (capacity == size)
+            return;
+        data     = realloc_and_check(data, capacity, size, name.c_str(), tag);
+        capacity = size;
+    }
+
+    // **************************************************************
+    void Clear()
+    /**
+     * Empty the array, keeping its memory.
+     */
+    {
+        size = 0;
+    }
+
+    // **************************************************************
+    inline T &       operator[](const uint64_t i)         { return data[i]; }
+    inline const T & operator[](const uint64_t i) const   { return data[i]; }
+    inline T *       Get_Data()                           { return data; }
+    inline uint64_t  Get_Size() const                     { return size; }
+    inline uint64_t  Get_Capacity() const                 { return capacity; }
+};
+
+#endif // INC_GROWABLE_ARRAY_HPP
+
+// ********** End of file ***************************************
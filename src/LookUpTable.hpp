@@ -4,13 +4,46 @@
 //const bool verbose = true;
 const bool verbose = false;
 
+#include <cmath>
 #include <string>
 
 #include "Memory.hpp"
+#include "LookUpTable_SIMD.hpp"
 #include "StdCout.hpp"
 
-template <class Double>
+// Points per block of read_batch_parallel() (one OpenMP iteration).
+const size_t lut_batch_block_size = 4096;
+
+// Initialize_To_Tolerance(): points compared with the function inside every
+// interval (equally spaced), and bounds on the number of points of the table.
+const int lut_tolerance_samples    = 3;    // Odd: includes the middle, where the linear error peaks
+const int lut_tolerance_min_points = 16;
+const int lut_tolerance_max_points = 1 << 26;
+
+// How the table is stored in memory.
+enum LookUpTable_Layout
+{
+    LUT_LAYOUT_VALUES,      // n values: read() loads table[i] and table[i+1]
+    LUT_LAYOUT_INTERLEAVED  // n {value, slope} pairs: read() loads one pair (same cache line) and does one multiply-add
+};
+
+// Derivatives at the points used by the cubic (Order 3) interpolation.
+enum LookUpTable_Tangents
+{
+    LUT_TANGENTS_FOURTH_ORDER,  // Five point centered differences: error in O(dx^4) for smooth functions
+    LUT_TANGENTS_CATMULL_ROM    // Three point centered differences (Catmull-Rom spline): O(dx^3)
+};
+
+template <class Double, int Order = 1>
 class LookUpTable
+/**
+ * Table of a function sampled at n equidistant points, interpolated between
+ * them. "Order" is the interpolation order: 1 (linear, the default) or 3
+ * (cubic Hermite, with the polynomial coefficients of every interval
+ * precomputed). Being a template parameter, read() has no branch on it;
+ * a cubic table reaches the accuracy of a linear one with far fewer points
+ * (so it can stay in cache).
+ */
 {
     private:
     std::string name;
@@ -19,8 +52,13 @@ class LookUpTable
     Double range_max;   // Maximum value of the sampling range
     Double dx;          // Step size (physical distance between two points)
     Double inv_dx;      // 1/(step size)
-    Double *table;      // Array that contains the values
+    Double *table;      // Array that contains the values (and slopes or polynomial coefficients)
+    LookUpTable_Layout layout;
+    LookUpTable_Tangents tangents;
+    int stride;         // Doubles per point: 1 (values), 2 ({value, slope}) or 4 (cubic coefficients)
     bool is_initialized; // Is the look up table initialized?
+    double measured_absolute_error; // Largest errors found by Measure_Error() (0 if never called)
+    double measured_relative_error;
     Double (*function)(Double); // Function pointer. Needs to take only one Double parameter and return a Double: function(x)
 
     public:
@@ -32,16 +70,22 @@ class LookUpTable
         dx          = 0.0;
         inv_dx      = 0.0;
         table       = NULL;
+        layout      = LUT_LAYOUT_VALUES;
+        tangents    = LUT_TANGENTS_FOURTH_ORDER;
+        stride      = (Order == 3 ? 4 : 1);
         function    = NULL;
         is_initialized = false;
+        measured_absolute_error = 0.0;
+        measured_relative_error = 0.0;
     }
 
     // **************************************************************
     LookUpTable(Double (*_function)(Double),
                 const Double _range_min, const Double _range_max,
-                const int _n, const std::string _name, Double *_table = NULL)
+                const int _n, const std::string _name, Double *_table = NULL,
+                const LookUpTable_Layout _layout = LUT_LAYOUT_VALUES)
     {
-        Initialize(_function, _range_min, _range_max, _n, _name, _table);
+        Initialize(_function, _range_min, _range_max, _n, _name, _table, _layout);
     }
 
     // **************************************************************
@@ -50,10 +94,11 @@ class LookUpTable
      * Copy constructor. Needed to allocate new memory and preventing double free corruptions.
      */
     {
-        Initialize(other_lut.function, other_lut.range_min, other_lut.range_max, other_lut.n, other_lut.name);
+        Initialize(other_lut.function, other_lut.range_min, other_lut.range_max, other_lut.n, other_lut.name, NULL, other_lut.layout);
+        tangents = other_lut.tangents;
 
         // Now copy the other_lut's table values, only if if was initialized.
-        if (other_lut.table != NULL)
+        if (other_lut.table != NULL && table != NULL)
             for (int i = 0 ; i < n ; i++)
                 Set(i, other_lut.Table(i));
     }
@@ -66,6 +111,9 @@ class LookUpTable
     Double  Get_XMax()                  { return range_max; }
     Double  Get_x_from_i(const int i)   { return Double(i)*dx + range_min; }
     const Double* Get_Pointer() const   { return table;     }
+    LookUpTable_Layout Get_Layout()     { return layout;    }
+    int     Get_Order()                 { return Order;     }
+    bool    Is_Initialized() const      { return is_initialized; }
 
     // **************************************************************
     Double Table(const int i) const
@@ -73,14 +121,23 @@ class LookUpTable
 #ifdef YDEBUG
         assert(i < n);
 #endif // #ifdef YDEBUG
-        return table[i];
+        return table[stride*i];
     }
 
     // **************************************************************
     void Initialize(Double (*_function)(Double),
                     const Double _range_min, const Double _range_max,
-                    const int _n, const std::string _name, Double *_table = NULL)
+                    const int _n, const std::string _name, Double *_table = NULL,
+                    const LookUpTable_Layout _layout = LUT_LAYOUT_VALUES)
+    /**
+     * "_table", if given, must hold n values (LUT_LAYOUT_VALUES), n
+     * {value, slope} pairs (LUT_LAYOUT_INTERLEAVED) or, for Order 3 (where
+     * the layout is ignored), n groups of 4 polynomial coefficients.
+     * If the table's memory is refused (see Memory_Over_Limit_Policy), the
+     * look up table stays uninitialized (see Is_Initialized()).
+     */
     {
+        assert(Order == 1 || Order == 3);
         is_initialized = true;
 
         function = _function;
@@ -88,6 +145,11 @@ class LookUpTable
         n           = _n;
         range_min   = _range_min;
         range_max   = _range_max;
+        layout      = (Order == 3 ? LUT_LAYOUT_VALUES : _layout);
+        tangents    = LUT_TANGENTS_FOURTH_ORDER;
+        stride      = (Order == 3 ? 4 : (layout == LUT_LAYOUT_INTERLEAVED ? 2 : 1));
+        measured_absolute_error = 0.0;
+        measured_relative_error = 0.0;
 
         if (_table != NULL)
         {
@@ -95,7 +157,13 @@ class LookUpTable
         }
         else
         {
-            table   = calloc_and_check<Double>(n, "LookUpTable");
+            table   = calloc_and_check_aligned<Double>(stride*n, Tag());
+            // Refused (MEMORY_POLICY_RETURN_NULL): nothing to fill.
+            if (table == NULL)
+            {
+                is_initialized = false;
+                return;
+            }
         }
 
         /*
@@ -129,12 +197,13 @@ class LookUpTable
             for (int i = 0 ; i < n ; i++)
             {
                 x        = Get_x_from_i(i);
-                table[i] = function(x);
+                table[stride*i] = function(x);
                 percentage = int(Double(i) / Double(n) * 100.0);
                 if (verbose and (percentage % 2) == 0)
                     printf(" %3d %%\b\b\b\b\b\b", percentage);
                 fflush(stdout);
             }
+            Compute_Coefficients(0, n-1);
         }
         else
         {
@@ -145,10 +214,126 @@ class LookUpTable
             std_cout << " Done.   \n" << std::flush;
     }
 
+    // **************************************************************
+    bool Initialize_To_Tolerance(Double (*_function)(Double),
+                                 const Double _range_min, const Double _range_max,
+                                 const double max_absolute_error, const double max_relative_error,
+                                 const std::string _name,
+                                 const LookUpTable_Layout _layout = LUT_LAYOUT_VALUES,
+                                 const int max_n = lut_tolerance_max_points)
+    /**
+     * Initialize() with the smallest number of points (within about 1%)
+     * for which the interpolation error, sampled by Measure_Error(), is
+     * at most max(max_absolute_error, max_relative_error*|f(x)|) everywhere.
+     * One of the tolerances can be 0; for a function crossing zero, a
+     * relative tolerance alone cannot be met near the root. The number of
+     * points is doubled until the tolerance is met, then bisected: the
+     * function is evaluated a few times the final table size, in trial
+     * tables. Returns false if even max_n points are not enough (the table
+     * then has max_n points). Also returns false, leaving the table
+     * uninitialized, if a table's memory is refused.
+     */
+    {
+        assert(!is_initialized);
+        assert(_function != NULL);
+        assert(max_absolute_error > 0.0 || max_relative_error > 0.0);
+
+        int failing = 0;
+        int n_ok    = (lut_tolerance_min_points < max_n ? lut_tolerance_min_points : max_n);
+        bool met    = false;
+        while (true)
+        {
+            LookUpTable<Double, Order> trial(_function, _range_min, _range_max, n_ok, _name, NULL, _layout);
+            if (!trial.Is_Initialized())
+                return false;
+            if (trial.Measure_Error(max_absolute_error, max_relative_error) <= 1.0)
+            {
+                met = true;
+                break;
+            }
+            if (n_ok >= max_n)
+                break;
+            failing = n_ok;
+            n_ok    = (n_ok <= max_n / 2 ? 2 * n_ok : max_n);
+        }
+
+        while (met && n_ok - failing > n_ok / 100 + 1)
+        {
+            const int middle = failing + (n_ok - failing) / 2;
+            LookUpTable<Double, Order> trial(_function, _range_min, _range_max, middle, _name, NULL, _layout);
+            if (!trial.Is_Initialized())
+                return false;
+            if (trial.Measure_Error(max_absolute_error, max_relative_error) <= 1.0)
+                n_ok = middle;
+            else
+                failing = middle;
+        }
+
+        Initialize(_function, _range_min, _range_max, n_ok, _name, NULL, _layout);
+        if (!is_initialized)
+            return false;
+        Measure_Error(max_absolute_error, max_relative_error);
+        if (!met)
+        {
+            Print();
+            std_cout << "WARNING: Lookup table \"" << name << "\" does not meet the requested tolerance!\n";
+        }
+        return met;
+    }
+
+    // **************************************************************
+    double Measure_Error(const double max_absolute_error, const double max_relative_error)
+    /**
+     * Compare the interpolation with the function at lut_tolerance_samples
+     * points inside every interval (in parallel). Keeps the largest absolute
+     * and relative errors (shown by Print()) and returns the largest ratio
+     * of the error to max(max_absolute_error, max_relative_error*|f(x)|):
+     * the table meets the tolerance if it is at most 1.
+     */
+    {
+        assert(function != NULL);
+        assert(table != NULL);
+
+        double max_ratio    = 0.0;
+        double max_absolute = 0.0;
+        double max_relative = 0.0;
+        #pragma omp parallel for schedule(static) reduction(max:max_ratio,max_absolute,max_relative)
+        for (int i = 0 ; i < n-1 ; i++)
+        {
+            for (int k = 0 ; k < lut_tolerance_samples ; k++)
+            {
+                const Double x        = range_min + dx*(Double(i) + Double(k + 1) / Double(lut_tolerance_samples + 1));
+                const double exact    = double(function(x));
+                const double error    = std::abs(double(read(x)) - exact);
+                const double relative = max_relative_error*std::abs(exact);
+                const double allowed  = (relative > max_absolute_error ? relative : max_absolute_error);
+                if (error > max_absolute)
+                    max_absolute = error;
+                if (std::abs(exact) > 0.0 && error / std::abs(exact) > max_relative)
+                    max_relative = error / std::abs(exact);
+                if (error > allowed)
+                {
+                    const double ratio = (allowed > 0.0 ? error / allowed : HUGE_VAL);
+                    if (ratio > max_ratio)
+                        max_ratio = ratio;
+                }
+            }
+        }
+
+        measured_absolute_error = max_absolute;
+        measured_relative_error = max_relative;
+
+        return max_ratio;
+    }
+
+    // **************************************************************
+    double  Get_Measured_Absolute_Error() { return measured_absolute_error; }
+    double  Get_Measured_Relative_Error() { return measured_relative_error; }
+
     // **************************************************************
     void Print()
     {
-        Double memsize = Double(n) * sizeof(Double);
+        Double memsize = Double(stride*n) * sizeof(Double);
         std::string suffix;
         if(memsize >= 1.024e3)
         {
@@ -173,8 +358,13 @@ class LookUpTable
             << "    Range:              [" << range_min << ", " << range_max << "]\n"
             << "    Number of points:   " << n << "\n"
             << "    dx:                 " << dx << "\n"
+            << "    Interpolation:      " << (Order == 3 ? (tangents == LUT_TANGENTS_CATMULL_ROM ? "cubic (Catmull-Rom)" : "cubic (Hermite)") : "linear") << "\n"
+            << "    Layout:             " << (Order == 3 ? "polynomial coefficients" : (layout == LUT_LAYOUT_INTERLEAVED ? "{value, slope} pairs" : "values")) << "\n"
             << "    Size:               " << memsize << " " << suffix << "B\n"
             << "    Pointer:            " << table << "\n";
+        if (measured_absolute_error > 0.0)
+            std_cout
+                << "    Measured error:     " << measured_absolute_error << " (relative: " << measured_relative_error << ")\n";
     }
 
     // **************************************************************
@@ -199,15 +389,57 @@ class LookUpTable
     // **************************************************************
     inline Double read(const Double x)
     /**
-     *   Reads the table and returns an interpolated (linear) value at point x.
+     *   Reads the table and returns an interpolated (linear or cubic) value at point x.
      */
     {
         const Double xnorm = (x - range_min)*inv_dx;
-        const int i        = int(floor(xnorm));
+        // x >= range_min: truncation is floor(), without the libm call.
+        int i              = int(xnorm);
 #ifdef YDEBUG
         assert(i < n);
 #endif // #ifdef YDEBUG
-        return table[i] + (table[i+1]-table[i])*(xnorm-Double(i));
+        // With rounding, x just below xmax can give i = n-1: read the
+        // last interval at t = 1 instead of loading table[n].
+        if (i > n-2)
+            i = n-2;
+        if (Order == 3)
+            return LUT_Interpolate<LUT_KERNEL_CUBIC>(table, i, xnorm-Double(i));
+        if (layout == LUT_LAYOUT_INTERLEAVED)
+            return LUT_Interpolate<LUT_KERNEL_LINEAR_INTERLEAVED>(table, i, xnorm-Double(i));
+        return LUT_Interpolate<LUT_KERNEL_LINEAR>(table, i, xnorm-Double(i));
+    }
+
+    // **************************************************************
+    inline void read_batch(const Double *x, Double *out, const size_t nb) const
+    /**
+     *   read() of the "nb" points "x" into "out", vectorized (see
+     *   LookUpTable_SIMD.hpp). Every x must be in [xmin, xmax[.
+     */
+    {
+        if (Order == 3)
+            LUT_Batch<LUT_KERNEL_CUBIC>(table, range_min, inv_dx, n-2, x, out, nb);
+        else if (layout == LUT_LAYOUT_INTERLEAVED)
+            LUT_Batch<LUT_KERNEL_LINEAR_INTERLEAVED>(table, range_min, inv_dx, n-2, x, out, nb);
+        else
+            LUT_Batch<LUT_KERNEL_LINEAR>(table, range_min, inv_dx, n-2, x, out, nb);
+    }
+
+    // **************************************************************
+    void read_batch_parallel(const Double *x, Double *out, const size_t nb) const
+    /**
+     *   read_batch() split over the OpenMP threads by blocks of
+     *   lut_batch_block_size points. To be called outside of parallel regions
+     *   (inside one, call read_batch() on each thread's part instead).
+     */
+    {
+        const long nb_blocks = long((nb + lut_batch_block_size - 1) / lut_batch_block_size);
+        #pragma omp parallel for schedule(static)
+        for (long b = 0 ; b < nb_blocks ; b++)
+        {
+            const size_t first = size_t(b) * lut_batch_block_size;
+            const size_t count = (nb - first < lut_batch_block_size ? nb - first : lut_batch_block_size);
+            read_batch(x + first, out + first, count);
+        }
     }
 
     // **************************************************************
@@ -221,7 +453,91 @@ class LookUpTable
         assert(i >= 0);
         assert(i <  n);
 
-        table[i] = x;
+        table[stride*i] = x;
+        // The tangents at i-2..i+2 depend on this value, and so do the
+        // one sided ones at the ends when it is one of the 5 last/first.
+        Compute_Coefficients(i-3, i+2);
+        if (i < 5)
+            Compute_Coefficients(0, 1);
+        if (i >= n-5)
+            Compute_Coefficients(n-3, n-1);
+    }
+
+    // **************************************************************
+    void Set_Tangents(const LookUpTable_Tangents _tangents)
+    /**
+     *   Choose how the derivatives are estimated for the cubic interpolation
+     *   (no effect with Order 1).
+     */
+    {
+        tangents = _tangents;
+        Compute_Coefficients(0, n-1);
+    }
+
+    // **************************************************************
+    Double Tangent(const int i) const
+    /**
+     *   Derivative (per step) at point i, from the values around it. Near
+     *   the ends, the five point differences are one sided.
+     */
+    {
+        if (n < 3)
+            return (n < 2 ? Double(0.0) : Table(1) - Table(0));
+        if (tangents == LUT_TANGENTS_CATMULL_ROM || n < 5)
+        {
+            if (i == 0)
+                return Double(0.5)*(Double(-3.0)*Table(0) + Double(4.0)*Table(1) - Table(2));
+            if (i == n-1)
+                return Double(0.5)*(Double(3.0)*Table(n-1) - Double(4.0)*Table(n-2) + Table(n-3));
+            return Double(0.5)*(Table(i+1) - Table(i-1));
+        }
+        // Mirrored stencils at the right end: the derivative changes sign.
+        const bool right = (i >= n-2);
+        const int  j     = (right ? n-1-i : i);
+        const int  s     = (right ? -1 : 1);
+        Double m;
+        if (j == 0)
+            m = (Double(-25.0)*Table(i) + Double(48.0)*Table(i+s) - Double(36.0)*Table(i+2*s)
+                 + Double(16.0)*Table(i+3*s) - Double(3.0)*Table(i+4*s)) / Double(12.0);
+        else if (j == 1)
+            m = (Double(-3.0)*Table(i-s) - Double(10.0)*Table(i) + Double(18.0)*Table(i+s)
+                 - Double(6.0)*Table(i+2*s) + Table(i+3*s)) / Double(12.0);
+        else
+            m = (Double(8.0)*(Table(i+1) - Table(i-1)) - (Table(i+2) - Table(i-2))) / Double(12.0);
+        return (right ? -m : m);
+    }
+
+    // **************************************************************
+    void Compute_Coefficients(const int first, const int last)
+    /**
+     *   From the values, store the slopes (LUT_LAYOUT_INTERLEAVED) or the
+     *   cubic Hermite coefficients (Order 3) of the intervals [first, last].
+     *   The last point is a constant.
+     */
+    {
+        if (Order == 1 && layout != LUT_LAYOUT_INTERLEAVED)
+            return;
+        for (int i = (first < 0 ? 0 : first) ; i <= last && i < n ; i++)
+        {
+            if (Order == 1)
+            {
+                table[2*i+1] = (i+1 < n ? Table(i+1) - Table(i) : Double(0.0));
+                continue;
+            }
+            Double *c = table + 4*i;
+            if (i+1 == n)
+            {
+                c[1] = c[2] = c[3] = Double(0.0);
+                continue;
+            }
+            const Double y0 = Table(i);
+            const Double y1 = Table(i+1);
+            const Double m0 = Tangent(i);
+            const Double m1 = Tangent(i+1);
+            c[1] = m0;
+            c[2] = Double(3.0)*(y1 - y0) - Double(2.0)*m0 - m1;
+            c[3] = Double(2.0)*(y0 - y1) + m0 + m1;
+        }
     }
 
     // **************************************************************
@@ -230,7 +546,7 @@ class LookUpTable
      *   Multiply the content of the table by a constant.
      */
     {
-        for (int i = 0 ; i < n ; i++)
+        for (int i = 0 ; i < stride*n ; i++)
         {
             table[i] *= x;
         }
@@ -247,7 +563,8 @@ class LookUpTable
         dx          *= conversion_x;
         inv_dx      /= conversion_x;
 
-        for (int i = 0 ; i < n ; i++)
+        // Slopes and coefficients are per step: they only scale with y.
+        for (int i = 0 ; i < stride*n ; i++)
         {
             table[i] *= conversion_y;
         }
@@ -256,7 +573,17 @@ class LookUpTable
     // **************************************************************
     ~LookUpTable()
     {
-        free_me(table, n);
+        free_me(table, stride*n, Tag());
+    }
+
+    // **************************************************************
+    static Memory_Tag Tag()
+    /**
+     * All tables are accounted for under the "LookUpTable" allocation tag.
+     */
+    {
+        static const Memory_Tag tag = allocated_memory.Register_Tag("LookUpTable");
+        return tag;
     }
 };
 
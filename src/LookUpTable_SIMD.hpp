@@ -0,0 +1,217 @@
+#ifndef INC_LUT_SIMD_HPP
+#define INC_LUT_SIMD_HPP
+
+/**
+ * Batched interpolation kernels used by LookUpTable::read_batch().
+ * The float and double overloads use AVX-512F or AVX2 (index computation,
+ * gather of the coefficients and interpolation, a full vector at a time)
+ * when the compiler targets them ("make optimized" uses -march=native);
+ * the remaining points, other types and other targets use the scalar loop.
+ * All points must be in [xmin, xmax[ of the table, like for read(): the
+ * index is then a truncation, no floor() needed. It is clamped to
+ * "last_i", the last interval, since x just below xmax can round to
+ * xnorm = n-1.
+ */
+
+#include <cstddef>  // size_t
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif // #if defined(__AVX2__) || defined(__AVX512F__)
+
+// What the table holds for every point (see LookUpTable_Layout and the
+// interpolation order of LookUpTable).
+enum LUT_Kernel
+{
+    LUT_KERNEL_LINEAR,              // Values: y[i] + (y[i+1]-y[i])*t
+    LUT_KERNEL_LINEAR_INTERLEAVED,  // {value, slope} pairs: one multiply-add
+    LUT_KERNEL_CUBIC                // {c0, c1, c2, c3} per interval: c0 + t*(c1 + t*(c2 + t*c3))
+};
+
+// **************************************************************
+template <LUT_Kernel Kernel, class Double>
+inline Double LUT_Interpolate(const Double *table, const int i, const Double t)
+/**
+ * Value at "t" (in [0,1[) of interval "i".
+ */
+{
+    if (Kernel == LUT_KERNEL_CUBIC)
+    {
+        const Double *c = table + 4*i;
+        return c[0] + t*(c[1] + t*(c[2] + t*c[3]));
+    }
+    if (Kernel == LUT_KERNEL_LINEAR_INTERLEAVED)
+        return table[2*i] + table[2*i+1]*t;
+    return table[i] + (table[i+1]-table[i])*t;
+}
+
+// **************************************************************
+template <LUT_Kernel Kernel, class Double>
+inline void LUT_Batch_Scalar(const Double *table, const Double xmin, const Double inv_dx, const int last_i,
+                             const Double *x, Double *out, const size_t first, const size_t nb)
+{
+    const Double *end = x + nb;
+    for (x += first, out += first ; x < end ; x++, out++)
+    {
+        const Double xnorm = (*x - xmin)*inv_dx;
+        int i              = int(xnorm);
+        if (i > last_i)
+            i = last_i;
+        *out = LUT_Interpolate<Kernel>(table, i, xnorm-Double(i));
+    }
+}
+
+// **************************************************************
+template <LUT_Kernel Kernel, class Double>
+inline void LUT_Batch(const Double *table, const Double xmin, const Double inv_dx, const int last_i,
+                      const Double *x, Double *out, const size_t nb)
+/**
+ * Types without a SIMD version.
+ */
+{
+    LUT_Batch_Scalar<Kernel>(table, xmin, inv_dx, last_i, x, out, 0, nb);
+}
+
+// **************************************************************
+template <LUT_Kernel Kernel>
+inline void LUT_Batch(const double *table, const double xmin, const double inv_dx, const int last_i,
+                      const double *x, double *out, const size_t nb)
+{
+    size_t k = 0;
+#if defined(__AVX512F__)
+    const __m512d vxmin   = _mm512_set1_pd(xmin);
+    const __m512d vinv_dx = _mm512_set1_pd(inv_dx);
+    const __m256i vlast_i = _mm256_set1_epi32(last_i);
+    for ( ; k + 8 <= nb ; k += 8)
+    {
+        const __m512d xnorm = _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(x + k), vxmin), vinv_dx);
+        const __m256i i     = _mm256_min_epi32(_mm512_cvttpd_epi32(xnorm), vlast_i);
+        const __m512d t     = _mm512_sub_pd(xnorm, _mm512_cvtepi32_pd(i));
+        __m512d y;
+        if (Kernel == LUT_KERNEL_CUBIC)
+        {
+            const __m256i index = _mm256_slli_epi32(i, 2);
+            const __m512d c3 = _mm512_i32gather_pd(index, table + 3, 8);
+            const __m512d c2 = _mm512_i32gather_pd(index, table + 2, 8);
+            const __m512d c1 = _mm512_i32gather_pd(index, table + 1, 8);
+            const __m512d c0 = _mm512_i32gather_pd(index, table,     8);
+            y = _mm512_fmadd_pd(_mm512_fmadd_pd(_mm512_fmadd_pd(c3, t, c2), t, c1), t, c0);
+        }
+        else
+        {
+            const __m256i index = (Kernel == LUT_KERNEL_LINEAR_INTERLEAVED ? _mm256_add_epi32(i, i) : i);
+            const __m512d y0    = _mm512_i32gather_pd(index, table, 8);
+            __m512d slope       = _mm512_i32gather_pd(index, table + 1, 8);
+            if (Kernel == LUT_KERNEL_LINEAR)
+                slope = _mm512_sub_pd(slope, y0);
+            y = _mm512_fmadd_pd(slope, t, y0);
+        }
+        _mm512_storeu_pd(out + k, y);
+    }
+#elif defined(__AVX2__)
+    const __m256d vxmin   = _mm256_set1_pd(xmin);
+    const __m256d vinv_dx = _mm256_set1_pd(inv_dx);
+    const __m128i vlast_i = _mm_set1_epi32(last_i);
+    for ( ; k + 4 <= nb ; k += 4)
+    {
+        const __m256d xnorm = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(x + k), vxmin), vinv_dx);
+        const __m128i i     = _mm_min_epi32(_mm256_cvttpd_epi32(xnorm), vlast_i);
+        const __m256d t     = _mm256_sub_pd(xnorm, _mm256_cvtepi32_pd(i));
+        __m256d y;
+        if (Kernel == LUT_KERNEL_CUBIC)
+        {
+            const __m128i index = _mm_slli_epi32(i, 2);
+            const __m256d c3 = _mm256_i32gather_pd(table + 3, index, 8);
+            const __m256d c2 = _mm256_i32gather_pd(table + 2, index, 8);
+            const __m256d c1 = _mm256_i32gather_pd(table + 1, index, 8);
+            const __m256d c0 = _mm256_i32gather_pd(table,     index, 8);
+            y = _mm256_add_pd(c0, _mm256_mul_pd(t, _mm256_add_pd(c1, _mm256_mul_pd(t, _mm256_add_pd(c2, _mm256_mul_pd(t, c3))))));
+        }
+        else
+        {
+            const __m128i index = (Kernel == LUT_KERNEL_LINEAR_INTERLEAVED ? _mm_add_epi32(i, i) : i);
+            const __m256d y0    = _mm256_i32gather_pd(table, index, 8);
+            __m256d slope       = _mm256_i32gather_pd(table + 1, index, 8);
+            if (Kernel == LUT_KERNEL_LINEAR)
+                slope = _mm256_sub_pd(slope, y0);
+            y = _mm256_add_pd(y0, _mm256_mul_pd(slope, t));
+        }
+        _mm256_storeu_pd(out + k, y);
+    }
+#endif // #if defined(__AVX512F__)
+    LUT_Batch_Scalar<Kernel>(table, xmin, inv_dx, last_i, x, out, k, nb);
+}
+
+// **************************************************************
+template <LUT_Kernel Kernel>
+inline void LUT_Batch(const float *table, const float xmin, const float inv_dx, const int last_i,
+                      const float *x, float *out, const size_t nb)
+{
+    size_t k = 0;
+#if defined(__AVX512F__)
+    const __m512 vxmin   = _mm512_set1_ps(xmin);
+    const __m512 vinv_dx = _mm512_set1_ps(inv_dx);
+    const __m512i vlast_i = _mm512_set1_epi32(last_i);
+    for ( ; k + 16 <= nb ; k += 16)
+    {
+        const __m512  xnorm = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(x + k), vxmin), vinv_dx);
+        const __m512i i     = _mm512_min_epi32(_mm512_cvttps_epi32(xnorm), vlast_i);
+        const __m512  t     = _mm512_sub_ps(xnorm, _mm512_cvtepi32_ps(i));
+        __m512 y;
+        if (Kernel == LUT_KERNEL_CUBIC)
+        {
+            const __m512i index = _mm512_slli_epi32(i, 2);
+            const __m512 c3 = _mm512_i32gather_ps(index, table + 3, 4);
+            const __m512 c2 = _mm512_i32gather_ps(index, table + 2, 4);
+            const __m512 c1 = _mm512_i32gather_ps(index, table + 1, 4);
+            const __m512 c0 = _mm512_i32gather_ps(index, table,     4);
+            y = _mm512_fmadd_ps(_mm512_fmadd_ps(_mm512_fmadd_ps(c3, t, c2), t, c1), t, c0);
+        }
+        else
+        {
+            const __m512i index = (Kernel == LUT_KERNEL_LINEAR_INTERLEAVED ? _mm512_add_epi32(i, i) : i);
+            const __m512  y0    = _mm512_i32gather_ps(index, table, 4);
+            __m512 slope        = _mm512_i32gather_ps(index, table + 1, 4);
+            if (Kernel == LUT_KERNEL_LINEAR)
+                slope = _mm512_sub_ps(slope, y0);
+            y = _mm512_fmadd_ps(slope, t, y0);
+        }
+        _mm512_storeu_ps(out + k, y);
+    }
+#elif defined(__AVX2__)
+    const __m256 vxmin   = _mm256_set1_ps(xmin);
+    const __m256 vinv_dx = _mm256_set1_ps(inv_dx);
+    const __m256i vlast_i = _mm256_set1_epi32(last_i);
+    for ( ; k + 8 <= nb ; k += 8)
+    {
+        const __m256  xnorm = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + k), vxmin), vinv_dx);
+        const __m256i i     = _mm256_min_epi32(_mm256_cvttps_epi32(xnorm), vlast_i);
+        const __m256  t     = _mm256_sub_ps(xnorm, _mm256_cvtepi32_ps(i));
+        __m256 y;
+        if (Kernel == LUT_KERNEL_CUBIC)
+        {
+            const __m256i index = _mm256_slli_epi32(i, 2);
+            const __m256 c3 = _mm256_i32gather_ps(table + 3, index, 4);
+            const __m256 c2 = _mm256_i32gather_ps(table + 2, index, 4);
+            const __m256 c1 = _mm256_i32gather_ps(table + 1, index, 4);
+            const __m256 c0 = _mm256_i32gather_ps(table,     index, 4);
+            y = _mm256_add_ps(c0, _mm256_mul_ps(t, _mm256_add_ps(c1, _mm256_mul_ps(t, _mm256_add_ps(c2, _mm256_mul_ps(t, c3))))));
+        }
+        else
+        {
+            const __m256i index = (Kernel == LUT_KERNEL_LINEAR_INTERLEAVED ? _mm256_add_epi32(i, i) : i);
+            const __m256  y0    = _mm256_i32gather_ps(table, index, 4);
+            __m256 slope        = _mm256_i32gather_ps(table + 1, index, 4);
+            if (Kernel == LUT_KERNEL_LINEAR)
+                slope = _mm256_sub_ps(slope, y0);
+            y = _mm256_add_ps(y0, _mm256_mul_ps(slope, t));
+        }
+        _mm256_storeu_ps(out + k, y);
+    }
+#endif // #if defined(__AVX512F__)
+    LUT_Batch_Scalar<Kernel>(table, xmin, inv_dx, last_i, x, out, k, nb);
+}
+
+#endif // INC_LUT_SIMD_HPP
+
+// ********** End of file ***************************************
@@ -0,0 +1,207 @@
+// **************************************************************
+//              Memory mapped files (out of core arrays)
+// **************************************************************
+
+#include <cerrno>
+#include <cstring>      // strerror()
+#include <new>          // std::bad_alloc
+#include <fcntl.h>      // open()
+#include <unistd.h>     // close(), ftruncate()
+#include <sys/mman.h>   // mmap(), munmap(), msync(), madvise()
+#include <sys/stat.h>   // fstat()
+
+#include "Memory.hpp"
+
+// **************************************************************
+static MEMORY_COLD void * Map_File_Failed(const char *filename, const uint64_t bytes, const std::string &reason, const char *msg)
+/**
+ * Mapping failed: returns NULL or throws if the over limit policy says so,
+ * else aborts.
+ */
+{
+    std_cout << "ERROR!!!\n";
+    std_cout << "    Mapping of ";
+    std_cout.Format(0,0,'d');
+    std_cout << bytes << " bytes of file \"" << filename << "\"";
+    std_cout.Format(0, 3, 'g');
+    std_cout << " (" << Bytes_to_MiBytes(bytes) << " MiB) FAILED: " << reason << "\n";
+    if (msg != NULL && msg[0] != '\0')
+    {
+        std_cout << "Comment: " << msg << std::endl;
+    }
+
+    switch (allocated_memory.Get_Over_Limit_Policy())
+    {
+        case MEMORY_POLICY_RETURN_NULL:
+            return NULL;
+
+        case MEMORY_POLICY_THROW:
+            throw std::bad_alloc();
+
+        default:
+            break;
+    }
+
+    std_cout << "Aborting.\n" << std::flush;
+    abort();
+}
+
+// **************************************************************
+static void Page_Range(const void *p, const uint64_t bytes, char *&start, size_t &length)
+/**
+ * Page aligned range covering [p, p+bytes) (for msync() and madvise()).
+ */
+{
+    start  = (char *) (uintptr_t(p) & ~uintptr_t(memory_page_size - 1));
+    length = size_t(static_cast<const char *>(p) + bytes - start);
+}
+
+// **************************************************************
+void * Memory_Map_File(const char *filename, const uint64_t bytes, const Memory_File_Mode mode, const char *msg)
+{
+    if (bytes == 0)
+        return NULL;
+
+    if (!allocated_memory.Reserve_Mapped_Bytes(bytes))
+        return Map_File_Failed(filename, bytes, "over the mapped files budget", msg);
+
+    int flags = O_RDWR | O_CREAT;
+    if (mode == MEMORY_FILE_READ)
+        flags = O_RDONLY;
+    else if (mode == MEMORY_FILE_CREATE)
+        flags |= O_TRUNC;
+
+    const int fd = open(filename, flags, 0644);
+    if (fd < 0)
+    {
+        const std::string reason = strerror(errno);
+        allocated_memory.Release_Mapped_Bytes(bytes);
+        return Map_File_Failed(filename, bytes, reason, msg);
+    }
+
+    struct stat status;
+    std::string reason;
+    if (fstat(fd, &status) != 0)
+        reason = strerror(errno);
+    else if (uint64_t(status.st_size) < bytes)
+    {
+        if (mode == MEMORY_FILE_READ)
+            reason = "file too small";
+        else if (ftruncate(fd, off_t(bytes)) != 0)
+            reason = strerror(errno);
+    }
+
+    void *p = MAP_FAILED;
+    if (reason.empty())
+    {
+        p = mmap(NULL, size_t(bytes), (mode == MEMORY_FILE_READ ? PROT_READ : PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            reason = strerror(errno);
+    }
+
+    // The mapping keeps its own reference to the file.
+    close(fd);
+
+    if (p == MAP_FAILED)
+    {
+        allocated_memory.Release_Mapped_Bytes(bytes);
+        return Map_File_Failed(filename, bytes, reason, msg);
+    }
+
+    return p;
+}
+
+// **************************************************************
+void Memory_Unmap_File(const void *p, const uint64_t bytes)
+{
+    munmap(const_cast<void *>(p), size_t(bytes));
+    allocated_memory.Release_Mapped_Bytes(bytes);
+}
+
+// **************************************************************
+bool Memory_Sync_File(const void *p, const uint64_t bytes, const bool wait)
+{
+    char *start;
+    size_t length;
+    Page_Range(p, bytes, start, length);
+    return msync(start, length, (wait ? MS_SYNC : MS_ASYNC)) == 0;
+}
+
+// **************************************************************
+void Memory_Advise_File(const void *p, const uint64_t bytes, const Memory_File_Advice advice)
+/**
+ * Only a hint: failures are ignored.
+ */
+{
+    int kernel_advice = MADV_NORMAL;
+    switch (advice)
+    {
+        case MEMORY_FILE_NORMAL:     kernel_advice = MADV_NORMAL;     break;
+        case MEMORY_FILE_SEQUENTIAL: kernel_advice = MADV_SEQUENTIAL; break;
+        case MEMORY_FILE_RANDOM:     kernel_advice = MADV_RANDOM;     break;
+        case MEMORY_FILE_WILLNEED:   kernel_advice = MADV_WILLNEED;   break;
+        case MEMORY_FILE_DONTNEED:   kernel_advice = MADV_DONTNEED;   break;
+    }
+
+    char *start;
+    size_t length;
+    Page_Range(p, bytes, start, length);
+    // MADV_DONTNEED does not write dirty pages back: they would only stay
+    // in the page cache. Write them first so they can be dropped.
+    if (advice == MEMORY_FILE_DONTNEED)
+        msync(start, length, MS_SYNC);
+    madvise(start, length, kernel_advice);
+}
+
+// **************************************************************
+bool Memory_Allocation::Reserve_Mapped_Bytes(const uint64_t bytes)
+/**
+ * Charge "bytes" to the mapped files budget. Returns false (nothing
+ * charged) if it would go over Get_Max_Mapped_Bytes().
+ */
+{
+    bool reserved = false;
+    #pragma omp critical (memory_mapped)
+    {
+        // The budget can have been lowered under what is already mapped.
+        if (mapped_bytes <= max_mapped_bytes && bytes <= max_mapped_bytes - mapped_bytes)
+        {
+            mapped_bytes += bytes;
+            reserved      = true;
+        }
+    }
+    return reserved;
+}
+
+// **************************************************************
+void Memory_Allocation::Release_Mapped_Bytes(const uint64_t bytes)
+{
+    #pragma omp critical (memory_mapped)
+    {
+        mapped_bytes -= bytes;
+    }
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Mapped_Bytes()
+{
+    return mapped_bytes;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Max_Mapped_Bytes()
+{
+    return max_mapped_bytes;
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Max_Mapped_Bytes(const uint64_t bytes)
+/**
+ * Limit on the total size of the files mapped at the same time (the
+ * address space, not the RAM, is what they use). Default: no limit.
+ */
+{
+    max_mapped_bytes = bytes;
+}
+
+// ********** End of file ***************************************
@@ -3,17 +3,106 @@
 // **************************************************************
 
 #include <limits> // std::numeric_limits<>::max()
-#include <cstdlib> // abort()
+#include <vector>
+#include <algorithm> // std::sort()
+#include <cstdlib> // abort(), posix_memalign()
+#include <cstdio>  // fileno()
+#include <cstring> // memset()
+#include <new>     // std::bad_alloc
+#include <unistd.h> // isatty()
+#include <time.h>  // nanosleep()
+#include <sys/time.h> // gettimeofday()
+#include <pthread.h> // pthread_getspecific() (without "__thread")
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif // #ifdef _OPENMP
 
 #include "Memory.hpp"
+#include "Pool.hpp"
+#include "Trace.hpp"
+#include "Registry.hpp"
 
 const int max_text_width = 97;
 
+bool memory_live_registry = false;
+
+// Set while the calling thread runs the shrinkers (see Shrink_And_Reserve()).
+static bool memory_shrinking = false;
+#pragma omp threadprivate(memory_shrinking)
+
+// **************************************************************
+// Atomic helpers for the byte counters. Threads (OpenMP) share the global
+// "allocated_memory" object, so every modification of a counter must be
+// atomic. GCC, Intel, Clang and PathScale all provide the "__sync" builtins;
+// other compilers fall back to a (named) OpenMP critical section.
+#if defined(__GNUC__) || defined(__INTEL_COMPILER) || defined(__clang__) || defined(__PATHSCALE__)
+static inline uint64_t Atomic_Add(uint64_t *counter, const uint64_t value)
+{
+    return __sync_add_and_fetch(counter, value);
+}
+static inline uint64_t Atomic_Sub(uint64_t *counter, const uint64_t value)
+{
+    return __sync_sub_and_fetch(counter, value);
+}
+static inline bool Atomic_CAS(uint64_t *counter, const uint64_t expected, const uint64_t desired)
+{
+    return __sync_bool_compare_and_swap(counter, expected, desired);
+}
+#else // #if defined(__GNUC__) || ...
+static inline uint64_t Atomic_Add(uint64_t *counter, const uint64_t value)
+{
+    uint64_t result;
+    #pragma omp critical (memory_allocation_counter)
+    {
+        *counter += value;
+        result = *counter;
+    }
+    return result;
+}
+static inline uint64_t Atomic_Sub(uint64_t *counter, const uint64_t value)
+{
+    uint64_t result;
+    #pragma omp critical (memory_allocation_counter)
+    {
+        *counter -= value;
+        result = *counter;
+    }
+    return result;
+}
+static inline bool Atomic_CAS(uint64_t *counter, const uint64_t expected, const uint64_t desired)
+{
+    bool swapped = false;
+    #pragma omp critical (memory_allocation_counter)
+    {
+        if (*counter == expected)
+        {
+            *counter = desired;
+            swapped = true;
+        }
+    }
+    return swapped;
+}
+#endif // #if defined(__GNUC__) || ...
+static inline uint64_t Atomic_Read(const uint64_t *counter)
+{
+    // Aligned 64 bits loads are atomic on all supported (64 bits) platforms.
+    return *((const volatile uint64_t *) counter);
+}
+
 Memory_Allocation allocated_memory;
 Memory_Allocation memory_to_allocate;
 
 void        Print_Factors();
 
+// **************************************************************
+static double Wall_Clock()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return double(tv.tv_sec) + 1.0e-6 * double(tv.tv_usec);
+}
+
 // **************************************************************
 void Print_N_Times(const std::string x, const int N, const bool newline)
 {
@@ -26,18 +115,288 @@ void Print_N_Times(const std::string x, const int N, const bool newline)
         std_cout << "\n";
 }
 
+// **************************************************************
+static void Print_Over_Limit_Warning(const uint64_t nb, const size_t s, const char *msg)
+{
+    const uint64_t nb_s = nb * s;
+
+    Memory_Allocation mem_temp = allocated_memory;
+    mem_temp += nb_s;
+
+    Print_N_Times("#", max_text_width);
+    std_cout
+        << "WARNING!!!\n    "
+        << "Trying to allocate:           ";
+    std_cout.Format(20,0,'d');
+    std_cout << nb << " x " << s << " bytes = " << nb_s << " bytes\n";
+    std_cout << "                                               (";
+    std_cout.Format(0, 3, 'g');
+    std_cout
+        << Bytes_to_KiBytes(nb_s) << " KiB, "
+        << Bytes_to_MiBytes(nb_s) << " MiB, "
+        << Bytes_to_GiBytes(nb_s) << " GiB)\n    "
+        << "but memory will be over the limit:\n";
+    std_cout << "                   ";
+    std_cout.Format(20,0,'d');
+    std_cout
+        << allocated_memory.Get_Max_Bytes() << " bytes, (";
+    std_cout.Format(0, 3, 'g');
+    std_cout
+        << allocated_memory.Get_Max_KiBytes() << " KiB, "
+        << allocated_memory.Get_Max_MiBytes() << " MiB, "
+        << allocated_memory.Get_Max_GiBytes() << " GiB)\n    "
+        << "Current usage: ";
+    std_cout.Format(20,0,'d');
+    std_cout
+        << allocated_memory.Get_Bytes_Allocated() << " bytes, (";
+    std_cout.Format(0, 3, 'g');
+    std_cout
+        << allocated_memory.Get_KiBytes_Allocated() << " KiB, "
+        << allocated_memory.Get_MiBytes_Allocated() << " MiB, "
+        << allocated_memory.Get_GiBytes_Allocated() << " GiB)\n    "
+        << "Wanted usage:  ";
+    std_cout.Format(20,0,'d');
+    std_cout
+        << mem_temp.Get_Bytes_Allocated() << " bytes, (";
+    std_cout.Format(0, 3, 'g');
+    std_cout
+        << mem_temp.Get_KiBytes_Allocated() << " KiB, "
+        << mem_temp.Get_MiBytes_Allocated() << " MiB, "
+        << mem_temp.Get_GiBytes_Allocated() << " GiB)\n";
+    if (msg != NULL && msg[0] != '\0')
+    {
+        std_cout << "    Comment: " << msg << std::endl;
+    }
+}
+
+// **************************************************************
+bool Memory_Over_Limit(const uint64_t nb, const size_t s, const char *msg, const int tag)
+/**
+ * Called by alloc_and_check() when the reservation of nb*s bytes failed.
+ * Call the shrinkers and, if still over the limit, apply the over limit policy. Returns true if the bytes are now charged
+ * (allocation can proceed) and false if alloc_and_check() must return NULL.
+ */
+{
+    const uint64_t nb_s = nb * s;
+
+    // Tagged allocations are described by their tag's name.
+    std::string tag_name;
+    if (tag != 0 && (msg == NULL || msg[0] == '\0'))
+    {
+        tag_name = allocated_memory.Get_Tag_Name(Memory_Tag(tag));
+        msg      = tag_name.c_str();
+    }
+
+    // First ask the registered shrinkers to release caches.
+    if (allocated_memory.Shrink_And_Reserve(nb_s, tag))
+        return true;
+
+    switch (allocated_memory.Get_Over_Limit_Policy())
+    {
+        case MEMORY_POLICY_RETURN_NULL:
+            return false;
+
+        case MEMORY_POLICY_THROW:
+            throw std::bad_alloc();
+
+        case MEMORY_POLICY_CALLBACK:
+        case MEMORY_POLICY_WAIT:
+            if (allocated_memory.Recover_Over_Limit(nb_s, tag))
+                return true;
+            break;
+
+        case MEMORY_POLICY_CONTINUE:
+            Print_Over_Limit_Warning(nb, s, msg);
+            std_cout << "Continuing (over limit policy)..." << std::endl << std::flush;
+            allocated_memory.Add_Bytes_Allocated(nb_s, tag);
+            return true;
+
+        case MEMORY_POLICY_ASK:
+        {
+            Print_Over_Limit_Warning(nb, s, msg);
+            std::string answer = MemPause("Are you sure you want to continue? [y,N]");
+            std_cout << std::flush;
+            if (answer == "y" || answer == "Y")
+            {
+                std_cout << "Continuing..." << std::endl << std::flush;
+
+                // User accepted to go over the limit
+                allocated_memory.Add_Bytes_Allocated(nb_s, tag);
+                return true;
+            }
+            std_cout << "Exiting.\n" << std::flush;
+            abort();
+        }
+
+        case MEMORY_POLICY_ABORT:
+        default:
+            break;
+    }
+
+    Print_Over_Limit_Warning(nb, s, msg);
+    std_cout << "Exiting.\n" << std::flush;
+    abort();
+}
+
+// **************************************************************
+void Memory_Allocation_Failed(const uint64_t nb, const size_t s, const size_t alignment, const char *msg, const int tag)
+/**
+ * Called by alloc_and_check() when malloc()/calloc()/posix_memalign() failed.
+ * Gives back the reserved bytes and, like for a failed file mapping, returns
+ * (alloc_and_check() then returns NULL) or throws std::bad_alloc if the over
+ * limit policy says so, else aborts.
+ */
+{
+    const uint64_t nb_s = nb * s;
+
+    allocated_memory.Free_Bytes_Allocated(nb_s, tag);
+
+    std::string tag_name;
+    if (tag != 0 && (msg == NULL || msg[0] == '\0'))
+    {
+        tag_name = allocated_memory.Get_Tag_Name(Memory_Tag(tag));
+        msg      = tag_name.c_str();
+    }
+
+    std_cout << "ERROR!!!\n";
+    std_cout << "    Allocation of ";
+    std_cout.Format(20,0,'d');
+    std_cout << nb << " x " << s << " bytes = " << nb_s << " bytes\n";
+    std_cout << "                                               (";
+    std_cout.Format(0, 3, 'g');
+    std_cout
+        << Bytes_to_KiBytes(nb_s) << " KiB, "
+        << Bytes_to_MiBytes(nb_s) << " MiB, "
+        << Bytes_to_GiBytes(nb_s) << " GiB)\n";
+    if (alignment != 0)
+    {
+        std_cout << "    aligned on " << alignment << " bytes (must be a power of two multiple of " << sizeof(void *) << ")\n";
+    }
+    std_cout << "    FAILED!!!\n";
+    if (msg != NULL && msg[0] != '\0')
+    {
+        std_cout << "Comment: " << msg << std::endl;
+    }
+
+    switch (allocated_memory.Get_Over_Limit_Policy())
+    {
+        case MEMORY_POLICY_RETURN_NULL:
+            return;
+
+        case MEMORY_POLICY_THROW:
+            throw std::bad_alloc();
+
+        default:
+            break;
+    }
+
+    std_cout << "Aborting.\n" << std::flush;
+    abort();
+}
+
 // **************************************************************
 Memory_Allocation::Memory_Allocation()
 {
     allocated_bytes     = 0;
     max_allocated_bytes = std::numeric_limits<uint64_t>::max();
+    shards              = NULL;
+    nb_shards           = 0;
+    shard_chunk         = 0;
+
+    // Never block on standard input if it is not a terminal (batch jobs).
+    if (isatty(fileno(stdin)))
+        over_limit_policy = MEMORY_POLICY_ASK;
+    else
+        over_limit_policy = MEMORY_POLICY_ABORT;
+    over_limit_callback      = NULL;
+    over_limit_callback_data = NULL;
+    over_limit_timeout       = 0.0;
+    nb_shrinkers             = 0;
+
+    // See Enable_Statistics()
+    statistics          = NULL;
+    nb_statistics       = 0;
+    peak_bytes          = 0;
+    rate_window         = 10.0;
+    rate_sample_index   = 0;
+    for (int i = 0 ; i < memory_rate_nb_samples ; i++)
+    {
+        rate_sample_times[i] = -1.0;
+        rate_sample_bytes[i] = 0;
+    }
+
+    tag_names[0] = "untagged";
+    nb_tags      = 1;
+
+    live_registry = NULL;
+
+    mapped_bytes     = 0;
+    max_mapped_bytes = std::numeric_limits<uint64_t>::max();
 }
 
 // **************************************************************
 Memory_Allocation::Memory_Allocation(Memory_Allocation &other)
+/**
+ * Copies are never sharded: they hold the (summed) total of "other".
+ */
 {
     allocated_bytes     = other.Get_Bytes_Allocated();
     max_allocated_bytes = other.Get_Max_Bytes();
+    shards              = NULL;
+    nb_shards           = 0;
+    shard_chunk         = 0;
+
+    over_limit_policy        = other.over_limit_policy;
+    over_limit_callback      = other.over_limit_callback;
+    over_limit_callback_data = other.over_limit_callback_data;
+    over_limit_timeout       = other.over_limit_timeout;
+    nb_shrinkers             = 0;
+
+    // Copies do not record statistics.
+    statistics          = NULL;
+    nb_statistics       = 0;
+    peak_bytes          = other.peak_bytes;
+    rate_window         = other.rate_window;
+    rate_sample_index   = 0;
+    for (int i = 0 ; i < memory_rate_nb_samples ; i++)
+    {
+        rate_sample_times[i] = -1.0;
+        rate_sample_bytes[i] = 0;
+    }
+
+    for (int t = 0 ; t < other.nb_tags ; t++)
+        tag_names[t] = other.tag_names[t];
+    nb_tags = other.nb_tags;
+
+    // Nor have a registry
+    live_registry = NULL;
+
+    mapped_bytes     = other.mapped_bytes;
+    max_mapped_bytes = other.max_mapped_bytes;
+}
+
+// **************************************************************
+Memory_Allocation::~Memory_Allocation()
+/**
+ * free_me() can still be called later by the destructors of other static
+ * objects (a global LookUpTable in another translation unit): without shards
+ * nor statistics, they only update the global counter.
+ */
+{
+    free(shards);
+    shards        = NULL;
+    nb_shards     = 0;
+    shard_chunk   = 0;
+    free(statistics);
+    statistics    = NULL;
+    nb_statistics = 0;
+
+    if (live_registry != NULL)
+    {
+        memory_live_registry = false;
+        delete live_registry;
+        live_registry = NULL;
+    }
 }
 
 // **************************************************************
@@ -60,7 +419,7 @@ Memory_Allocation Memory_Allocation::operator=(Memory_Allocation &right_hand_sid
 // **************************************************************
 Memory_Allocation Memory_Allocation::operator-=(Memory_Allocation &right_hand_side)
 {
-    allocated_bytes -= right_hand_side.Get_Bytes_Allocated();
+    Release_Bytes(right_hand_side.Get_Bytes_Allocated(), 0);
 
     return *this;
 }
@@ -68,7 +427,7 @@ Memory_Allocation Memory_Allocation::operator-=(Memory_Allocation &right_hand_si
 // **************************************************************
 Memory_Allocation Memory_Allocation::operator+=(Memory_Allocation &right_hand_side)
 {
-    allocated_bytes += right_hand_side.Get_Bytes_Allocated();
+    Add_Bytes_Allocated(right_hand_side.Get_Bytes_Allocated(), 0);
 
     return *this;
 }
@@ -76,7 +435,7 @@ Memory_Allocation Memory_Allocation::operator+=(Memory_Allocation &right_hand_si
 // **************************************************************
 Memory_Allocation Memory_Allocation::operator-=(const uint64_t right_hand_side)
 {
-    allocated_bytes -= right_hand_side;
+    Release_Bytes(right_hand_side, 0);
 
     return *this;
 }
@@ -84,7 +443,7 @@ Memory_Allocation Memory_Allocation::operator-=(const uint64_t right_hand_side)
 // **************************************************************
 Memory_Allocation Memory_Allocation::operator+=(const uint64_t right_hand_side)
 {
-    allocated_bytes += right_hand_side;
+    Add_Bytes_Allocated(right_hand_side, 0);
 
     return *this;
 }
@@ -116,7 +475,7 @@ bool Memory_Allocation::Under_Limit()
         return true;
     else
     {
-        if (allocated_bytes < max_allocated_bytes)
+        if (Get_Bytes_Allocated() < max_allocated_bytes)
             return true;
         else
             return false;
@@ -124,158 +483,1198 @@ bool Memory_Allocation::Under_Limit()
 }
 
 // **************************************************************
-void Memory_Allocation::Verify_Limit(const bool verbose)
+bool Memory_Allocation::Reserve_Global_Bytes(const uint64_t to_add, uint64_t &usage)
+/**
+ * Atomically add "to_add" bytes to the global counter, but only if the result
+ * stays under the limit (same condition as Under_Limit()). Returns false
+ * (and leaves the counter untouched) if the limit would be exceeded, else
+ * true with "usage" the counter's value after this reservation.
+ * Lock-free: the counter is read, checked against the limit, and only then
+ * updated with a compare-and-swap, so it never (even transiently) goes over
+ * the limit and concurrent reservations that fit are never refused.
+ */
 {
-    if (!Under_Limit())
+    if (MEMORY_UNLIKELY(max_allocated_bytes == 0))
     {
-        Print_N_Times("#", max_text_width);
-        std_cout
-            << "WARNING!!!" << std::endl << "    "
-            << "Memory needed:          "
-                << Get_Bytes_Allocated()   << " bytes, "
-                << Get_KiBytes_Allocated() << " KiB, "
-                << Get_MiBytes_Allocated() << " MiB, "
-                << Get_GiBytes_Allocated() << " GiB" << std::endl << "    "
-            << "will be over the limit: "
-                << Get_Max_Bytes()   << " bytes, "
-                << Get_Max_KiBytes() << " KiB, "
-                << Get_Max_MiBytes() << " MiB, "
-                << Get_Max_GiBytes() << " GiB" << std::endl << "    "
-            << "Currently using:        "
-                << allocated_memory.Get_Bytes_Allocated()   << " bytes, "
-                << allocated_memory.Get_KiBytes_Allocated() << " KiB, "
-                << allocated_memory.Get_MiBytes_Allocated() << " MiB, "
-                << allocated_memory.Get_GiBytes_Allocated() << " GiB" << std::endl;
+        usage = Atomic_Add(&allocated_bytes, to_add);
+        return true;
+    }
 
-        std::string answer = MemPause("Are you sure you want to continue? [y,N]");
-        if ( ! (answer == "y" || answer == "Y"))
-        {
-            std_cout << "Exiting." << std::endl << std::flush;
-            abort();
-        }
-        std_cout << "Continuing..." << std::endl << std::flush;
-    } else {
-        if (verbose)
+    uint64_t current;
+    uint64_t wanted;
+    do
+    {
+        current = Atomic_Read(&allocated_bytes);
+        wanted  = current + to_add;
+        if (MEMORY_UNLIKELY(wanted >= max_allocated_bytes))
+            return false;
+    } while (MEMORY_UNLIKELY(!Atomic_CAS(&allocated_bytes, current, wanted)));
+
+    usage = wanted;
+    return true;
+}
+
+// **************************************************************
+bool Memory_Allocation::Reserve_Bytes(const uint64_t to_add, const int tag)
+/**
+ * Reserve "to_add" bytes (charged to allocation tag "tag") if it keeps the
+ * usage under the limit.
+ */
+{
+    bool reserved;
+    uint64_t usage = 0;
+    if (shards == NULL)
+        reserved = Reserve_Global_Bytes(to_add, usage);
+    else
+        reserved = Reserve_Shard_Bytes(to_add, usage);
+
+    if (reserved)
+        Record_Allocation(to_add, tag, usage);
+
+    return reserved;
+}
+
+// **************************************************************
+bool Memory_Allocation::Reserve_Shard_Bytes(const uint64_t to_add, uint64_t &usage)
+/**
+ * With sharded counters, the bytes are first taken from the calling
+ * thread's shard; the global counter is only touched (by chunks of
+ * "shard_chunk" bytes) when the shard's budget is exhausted. "usage" is
+ * then set to the usage (net of the shards' budgets); it is left untouched
+ * when the bytes came from the shard.
+ */
+{
+    Memory_Shard &shard = Current_Shard();
+
+    // Fast path: take the bytes from this thread's budget.
+    uint64_t budget;
+    do
+    {
+        budget = Atomic_Read(&shard.budget);
+        if (budget < to_add)
+            break;
+    } while (!Atomic_CAS(&shard.budget, budget, budget - to_add));
+    if (budget >= to_add)
+        return true;
+
+    uint64_t global_usage;
+
+    // Top the shard up to one chunk (along with what is needed now), so that
+    // it never holds more than 2*shard_chunk bytes (see Release_Bytes())...
+    const uint64_t top_up = (budget < shard_chunk ? shard_chunk - budget : 0);
+    if (Reserve_Global_Bytes(to_add + top_up, global_usage))
+    {
+        Atomic_Add(&shard.budget, top_up);
+        usage = Get_Bytes_Allocated();
+        return true;
+    }
+
+    // ...unless we are close to the limit: then reserve exactly what is needed.
+    if (!Reserve_Global_Bytes(to_add, global_usage))
+        return false;
+    usage = Get_Bytes_Allocated();
+    return true;
+}
+
+// **************************************************************
+void Memory_Allocation::Release_Bytes(const uint64_t bytes_freed, const int tag)
+/**
+ * Give back bytes. When the counters are sharded, they go to the calling
+ * thread's shard and only the excess over "shard_chunk" is returned to the
+ * global counter, so a shard never holds more than 2*shard_chunk bytes.
+ */
+{
+    if (shards == NULL)
+    {
+        Atomic_Sub(&allocated_bytes, bytes_freed);
+    }
+    else
+    {
+        Memory_Shard &shard = Current_Shard();
+
+        uint64_t budget = Atomic_Add(&shard.budget, bytes_freed);
+        if (budget > 2*shard_chunk)
         {
-            Print_N_Times("#", max_text_width);
-            std_cout
-                << "Code's expected memory usage: "
-                    << Get_Bytes_Allocated()   << " bytes, "
-                    << Get_KiBytes_Allocated() << " KiB, "
-                    << Get_MiBytes_Allocated() << " MiB, "
-                    << Get_GiBytes_Allocated() << " GiB" << std::endl
-                << "Limit: "
-                    << Get_Max_Bytes()   << " bytes, "
-                    << Get_Max_KiBytes() << " KiB, "
-                    << Get_Max_MiBytes() << " MiB, "
-                    << Get_Max_GiBytes() << " GiB" << std::endl;
-            Print_N_Times("#", max_text_width);
+            while (budget > shard_chunk && !Atomic_CAS(&shard.budget, budget, shard_chunk))
+                budget = Atomic_Read(&shard.budget);
+            if (budget > shard_chunk)
+                Atomic_Sub(&allocated_bytes, budget - shard_chunk);
         }
     }
+
+    // After the counters, so that the usage seen by the trace is up to date.
+    Record_Free(bytes_freed, tag);
 }
 
 // **************************************************************
-uint64_t Memory_Allocation::Get_Bytes_Allocated()
+static uint64_t memory_nb_thread_indices = 0;
+
+#if defined(__GNUC__) || defined(__INTEL_COMPILER) || defined(__clang__) || defined(__PATHSCALE__)
+__thread int memory_thread_index = -1;
+#else // #if defined(__GNUC__) || ...
+static pthread_key_t  memory_thread_key;
+static pthread_once_t memory_thread_key_once = PTHREAD_ONCE_INIT;
+
+static void Create_Thread_Key()
 {
-    return allocated_bytes;
+    pthread_key_create(&memory_thread_key, NULL);
 }
 
 // **************************************************************
-double Memory_Allocation::Get_KiBytes_Allocated()
+int Memory_Thread_Index()
+/**
+ * Without "__thread", the index is kept (plus one: NULL is "none yet") in
+ * thread specific data.
+ */
 {
-    return Bytes_to_KiBytes(Get_Bytes_Allocated());
+    pthread_once(&memory_thread_key_once, Create_Thread_Key);
+    void *value = pthread_getspecific(memory_thread_key);
+    if (value == NULL)
+    {
+        value = reinterpret_cast<void *>(intptr_t(Memory_New_Thread_Index()) + 1);
+        pthread_setspecific(memory_thread_key, value);
+    }
+    return int(reinterpret_cast<intptr_t>(value)) - 1;
 }
+#endif // #if defined(__GNUC__) || ...
 
 // **************************************************************
-double Memory_Allocation::Get_MiBytes_Allocated()
+int Memory_New_Thread_Index()
 {
-    return Bytes_to_MiBytes(Get_Bytes_Allocated());
+    return int(Atomic_Add(&memory_nb_thread_indices, 1) - 1);
 }
 
 // **************************************************************
-double Memory_Allocation::Get_GiBytes_Allocated()
+static inline int Thread_Number()
 {
-    return Bytes_to_GiBytes(Get_Bytes_Allocated());
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else // #ifdef _OPENMP
+    return 0;
+#endif // #ifdef _OPENMP
 }
 
 // **************************************************************
-void Memory_Allocation::Add_Bytes_Allocated(uint64_t to_add)
+Memory_Shard & Memory_Allocation::Current_Shard()
 {
-    allocated_bytes += to_add;
+    return shards[Thread_Number() % nb_shards];
 }
 
 // **************************************************************
-void Memory_Allocation::Free_Bytes_Allocated(uint64_t bytes_freed)
+static inline int Log2_Bucket(uint64_t bytes)
+/**
+ * floor(log2(bytes)), 0 for 0 bytes.
+ */
 {
-    allocated_bytes -= bytes_freed;
+    if (bytes == 0)
+        return 0;
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(bytes);
+#else // #if defined(__GNUC__)
+    int bucket = 0;
+    while (bytes >>= 1)
+        bucket++;
+    return bucket;
+#endif // #if defined(__GNUC__)
 }
 
 // **************************************************************
-uint64_t Memory_Allocation::Get_Max_Bytes()
+void Memory_Allocation::Record_Allocation(const uint64_t bytes, const int tag, const uint64_t usage)
+/**
+ * Update the peak usage, given the "usage" this allocation produced (0 if
+ * unknown: with sharded counters, it is only known when the global counter
+ * is touched, so the peak is then exact up to the slack), and the calling
+ * thread's statistics if enabled (see Enable_Statistics()).
+ */
 {
-    return max_allocated_bytes;
+    if (MEMORY_UNLIKELY(memory_tracing))
+        Memory_Trace_Event_Hook(int64_t(bytes), tag);
+
+    // Only a new peak (rare) is written.
+    if (MEMORY_UNLIKELY(usage > Atomic_Read(&peak_bytes)))
+        Update_Peak(usage);
+
+    if (MEMORY_UNLIKELY(statistics != NULL))
+        Record_Statistics(bytes, tag);
 }
 
 // **************************************************************
-double Memory_Allocation::Get_Max_KiBytes()
+void Memory_Allocation::Record_Statistics(const uint64_t bytes, const int tag)
+/**
+ * Threads without a slot of their own (see Memory_Statistics) update the
+ * shared one atomically.
+ */
 {
-    return Bytes_to_KiBytes(max_allocated_bytes);
+    const int thread = Memory_Thread_Index();
+    const int shared = nb_statistics - 1;
+    Memory_Statistics &stats = statistics[thread < shared ? thread : shared];
+    uint64_t nb_allocations;
+    if (MEMORY_UNLIKELY(thread >= shared))
+    {
+        nb_allocations = Atomic_Add(&stats.nb_allocations, 1);
+        Atomic_Add(&stats.bytes_allocated, bytes);
+        Atomic_Add(&stats.size_histogram[Log2_Bucket(bytes)], 1);
+        Atomic_Add(&stats.tag_bytes[tag], bytes);
+        Atomic_Add(&stats.tag_nb_allocations[tag], 1);
+    }
+    else
+    {
+        nb_allocations = ++stats.nb_allocations;
+        stats.bytes_allocated += bytes;
+        stats.size_histogram[Log2_Bucket(bytes)]++;
+        stats.tag_bytes[tag] += bytes;
+        stats.tag_nb_allocations[tag]++;
+    }
+
+    // Sample the allocation rate from time to time.
+    if ((nb_allocations & 4095) == 0)
+        Sample_Rate();
 }
 
 // **************************************************************
-double Memory_Allocation::Get_Max_MiBytes()
+void Memory_Allocation::Update_Peak(const uint64_t usage)
 {
-    return Bytes_to_MiBytes(max_allocated_bytes);
+    uint64_t peak;
+    while (usage > (peak = Atomic_Read(&peak_bytes)) && !Atomic_CAS(&peak_bytes, peak, usage))
+        ;
 }
 
 // **************************************************************
-double Memory_Allocation::Get_Max_GiBytes()
+void Memory_Allocation::Record_Free(const uint64_t bytes, const int tag)
 {
-    return Bytes_to_GiBytes(max_allocated_bytes);
+    if (MEMORY_UNLIKELY(memory_tracing))
+        Memory_Trace_Event_Hook(-int64_t(bytes), tag);
+
+    if (statistics == NULL)
+        return;
+
+    const int thread = Memory_Thread_Index();
+    const int shared = nb_statistics - 1;
+    if (MEMORY_UNLIKELY(thread >= shared))
+    {
+        Memory_Statistics &stats = statistics[shared];
+        Atomic_Add(&stats.nb_frees, 1);
+        Atomic_Add(&stats.bytes_freed, bytes);
+        Atomic_Sub(&stats.tag_bytes[tag], bytes);
+    }
+    else
+    {
+        Memory_Statistics &stats = statistics[thread];
+        stats.nb_frees++;
+        stats.bytes_freed += bytes;
+        stats.tag_bytes[tag] -= bytes;
+    }
 }
 
 // **************************************************************
-void Memory_Allocation::Set_Max_Bytes(uint64_t bytes)
+void Memory_Allocation::Enable_Statistics()
+/**
+ * Opt-in: count allocations and frees, the sizes histogram, the allocation
+ * rate and the usage per tag (the peak is always kept). Each thread updates
+ * its own (cache line padded) slot. Counts start now: enable them at
+ * start-up, or the tags of blocks allocated before get negative bytes when
+ * they are freed. Must be called outside of a parallel region.
+ */
 {
-    max_allocated_bytes = bytes;
+    if (statistics != NULL)
+        return;
+
+    // One slot per thread, plus the shared one.
+#ifdef _OPENMP
+    nb_statistics = omp_get_max_threads() + 1;
+#else // #ifdef _OPENMP
+    nb_statistics = 2;
+#endif // #ifdef _OPENMP
+    void *p = NULL;
+    if (posix_memalign(&p, MEMORY_CACHE_LINE_SIZE, nb_statistics * sizeof(Memory_Statistics)) != 0)
+    {
+        std_cout << "ERROR: Can't allocate memory for " << nb_statistics << " statistics.\n";
+        abort();
+    }
+    memset(p, 0, nb_statistics * sizeof(Memory_Statistics));
+    statistics = static_cast<Memory_Statistics *>(p);
 }
 
 // **************************************************************
-void Memory_Allocation::Set_Max_KiBytes(double kbytes)
+void Memory_Allocation::Disable_Statistics()
+/**
+ * Forget the statistics. Must be called outside of a parallel region.
+ */
 {
-    max_allocated_bytes = KiBytes_to_Bytes(kbytes);
+    free(statistics);
+    statistics    = NULL;
+    nb_statistics = 0;
 }
 
 // **************************************************************
-void Memory_Allocation::Set_Max_MiBytes(double mbytes)
+bool Memory_Allocation::Are_Statistics_Enabled()
 {
-    max_allocated_bytes = MiBytes_to_Bytes(mbytes);
+    return (statistics != NULL);
 }
 
 // **************************************************************
-void Memory_Allocation::Set_Max_GiBytes(double gbytes)
+void Memory_Allocation::Enable_Sharded_Counters(const uint64_t slack_bytes)
+/**
+ * Opt-in: use one (cache line padded) counter per thread. Threads then only
+ * touch the shared counter once per chunk instead of once per allocation.
+ * The limit stays exact up to "slack_bytes": bytes sitting unused in the
+ * shards are counted against the limit, so an allocation can be refused
+ * while the real usage is at most "slack_bytes" under the limit.
+ * Must be called outside of a parallel region.
+ */
 {
-    max_allocated_bytes = GiBytes_to_Bytes(gbytes);
+    Disable_Sharded_Counters();
+
+#ifdef _OPENMP
+    nb_shards = omp_get_max_threads();
+#else // #ifdef _OPENMP
+    nb_shards = 1;
+#endif // #ifdef _OPENMP
+
+    // Every shard can hold up to 2 chunks.
+    shard_chunk = slack_bytes / uint64_t(2*nb_shards);
+
+    void *p = NULL;
+    if (posix_memalign(&p, MEMORY_CACHE_LINE_SIZE, nb_shards * sizeof(Memory_Shard)) != 0)
+    {
+        std_cout << "ERROR: Can't allocate memory for " << nb_shards << " sharded counters.\n";
+        abort();
+    }
+    shards = static_cast<Memory_Shard *>(p);
+    for (int i = 0 ; i < nb_shards ; i++)
+        shards[i].budget = 0;
 }
 
 // **************************************************************
-void Memory_Allocation::Print()
+void Memory_Allocation::Disable_Sharded_Counters()
+/**
+ * Give back all the shards' budgets to the global counter.
+ * Must be called outside of a parallel region.
+ */
 {
-    std_cout << "Memory allocated:       ";
-    std_cout.Format(20,0,'d');
-    std_cout    << Get_Bytes_Allocated()   << " bytes (";
-    std_cout.Format(0, 3, 'g');
-    std_cout    << Get_KiBytes_Allocated() << " KiB, "
-                << Get_MiBytes_Allocated() << " MiB, "
-                << Get_GiBytes_Allocated() << " GiB)\n";
+    if (shards == NULL)
+        return;
 
-    std_cout << "Maximum memory allowed: ";
+    for (int i = 0 ; i < nb_shards ; i++)
+        Atomic_Sub(&allocated_bytes, shards[i].budget);
+
+    free(shards);
+    shards      = NULL;
+    nb_shards   = 0;
+    shard_chunk = 0;
+}
+
+// **************************************************************
+bool Memory_Allocation::Are_Counters_Sharded()
+{
+    return (shards != NULL);
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Slack_Bytes()
+{
+    return uint64_t(2*nb_shards) * shard_chunk;
+}
+
+// **************************************************************
+bool Memory_Allocation::Verify_Limit(const bool verbose)
+/**
+ * Verify that the usage is under the limit. If not, the over limit policy
+ * decides: MEMORY_POLICY_ASK asks the user, MEMORY_POLICY_ABORT aborts,
+ * MEMORY_POLICY_THROW throws std::bad_alloc and the others return false.
+ */
+{
+    if (!Under_Limit())
+    {
+        Print_N_Times("#", max_text_width);
+        std_cout
+            << "WARNING!!!" << std::endl << "    "
+            << "Memory needed:          "
+                << Get_Bytes_Allocated()   << " bytes, "
+                << Get_KiBytes_Allocated() << " KiB, "
+                << Get_MiBytes_Allocated() << " MiB, "
+                << Get_GiBytes_Allocated() << " GiB" << std::endl << "    "
+            << "will be over the limit: "
+                << Get_Max_Bytes()   << " bytes, "
+                << Get_Max_KiBytes() << " KiB, "
+                << Get_Max_MiBytes() << " MiB, "
+                << Get_Max_GiBytes() << " GiB" << std::endl << "    "
+            << "Currently using:        "
+                << allocated_memory.Get_Bytes_Allocated()   << " bytes, "
+                << allocated_memory.Get_KiBytes_Allocated() << " KiB, "
+                << allocated_memory.Get_MiBytes_Allocated() << " MiB, "
+                << allocated_memory.Get_GiBytes_Allocated() << " GiB" << std::endl;
+
+        if (over_limit_policy == MEMORY_POLICY_THROW)
+            throw std::bad_alloc();
+
+        if (over_limit_policy == MEMORY_POLICY_ASK)
+        {
+            std::string answer = MemPause("Are you sure you want to continue? [y,N]");
+            if ( ! (answer == "y" || answer == "Y"))
+            {
+                std_cout << "Exiting." << std::endl << std::flush;
+                abort();
+            }
+        }
+        else if (over_limit_policy == MEMORY_POLICY_ABORT)
+        {
+            std_cout << "Exiting." << std::endl << std::flush;
+            abort();
+        }
+        std_cout << "Continuing..." << std::endl << std::flush;
+        return false;
+    } else {
+        if (verbose)
+        {
+            Print_N_Times("#", max_text_width);
+            std_cout
+                << "Code's expected memory usage: "
+                    << Get_Bytes_Allocated()   << " bytes, "
+                    << Get_KiBytes_Allocated() << " KiB, "
+                    << Get_MiBytes_Allocated() << " MiB, "
+                    << Get_GiBytes_Allocated() << " GiB" << std::endl
+                << "Limit: "
+                    << Get_Max_Bytes()   << " bytes, "
+                    << Get_Max_KiBytes() << " KiB, "
+                    << Get_Max_MiBytes() << " MiB, "
+                    << Get_Max_GiBytes() << " GiB" << std::endl;
+            Print_N_Times("#", max_text_width);
+        }
+    }
+    return true;
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Over_Limit_Policy(const Memory_Over_Limit_Policy policy)
+{
+    over_limit_policy = policy;
+}
+
+// **************************************************************
+Memory_Over_Limit_Policy Memory_Allocation::Get_Over_Limit_Policy()
+{
+    return over_limit_policy;
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Over_Limit_Callback(Memory_Over_Limit_Callback callback, void *user_data)
+/**
+ * Callback used by MEMORY_POLICY_CALLBACK (which it also selects).
+ */
+{
+    over_limit_callback      = callback;
+    over_limit_callback_data = user_data;
+    over_limit_policy        = MEMORY_POLICY_CALLBACK;
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Over_Limit_Timeout(const double seconds)
+/**
+ * How long MEMORY_POLICY_WAIT (which it also selects) waits for memory.
+ */
+{
+    over_limit_timeout = seconds;
+    over_limit_policy  = MEMORY_POLICY_WAIT;
+}
+
+// **************************************************************
+void Memory_Allocation::Register_Shrinker(Memory_Shrinker shrinker, void *user_data, const int priority)
+/**
+ * Register a function releasing memory (caches) under memory pressure.
+ * Shrinkers are called by increasing "priority" (then by registration
+ * order) until the allocation fits under the limit.
+ */
+{
+    Memory_Shrinker_Entry entry;
+    entry.shrinker  = shrinker;
+    entry.user_data = user_data;
+    entry.priority  = priority;
+
+    #pragma omp critical (memory_shrinkers)
+    {
+        std::vector<Memory_Shrinker_Entry>::iterator it = shrinkers.begin();
+        while (it != shrinkers.end() && it->priority <= priority)
+            ++it;
+        shrinkers.insert(it, entry);
+        Atomic_Add(&nb_shrinkers, 1);
+    }
+}
+
+// **************************************************************
+void Memory_Allocation::Unregister_Shrinker(Memory_Shrinker shrinker, void *user_data)
+/**
+ * Once this returns, the shrinker is not called anymore: if another thread
+ * is running the shrinkers, wait for it to finish. A shrinker can
+ * unregister itself (or another one) while it runs.
+ */
+{
+    if (memory_shrinking)
+    {
+        Remove_Shrinker(shrinker, user_data);
+    }
+    else
+    {
+        #pragma omp critical (memory_shrinking)
+        Remove_Shrinker(shrinker, user_data);
+    }
+}
+
+// **************************************************************
+void Memory_Allocation::Remove_Shrinker(Memory_Shrinker shrinker, void *user_data)
+{
+    #pragma omp critical (memory_shrinkers)
+    {
+        for (std::vector<Memory_Shrinker_Entry>::iterator it = shrinkers.begin() ; it != shrinkers.end() ; ++it)
+        {
+            if (it->shrinker == shrinker && it->user_data == user_data)
+            {
+                shrinkers.erase(it);
+                Atomic_Sub(&nb_shrinkers, 1);
+                break;
+            }
+        }
+    }
+}
+
+// **************************************************************
+bool Memory_Allocation::Is_Shrinker_Registered(const Memory_Shrinker_Entry &entry)
+{
+    bool registered = false;
+    #pragma omp critical (memory_shrinkers)
+    {
+        for (size_t i = 0 ; i < shrinkers.size() && !registered ; i++)
+            registered = (shrinkers[i].shrinker == entry.shrinker && shrinkers[i].user_data == entry.user_data);
+    }
+    return registered;
+}
+
+// **************************************************************
+bool Memory_Allocation::Shrink_And_Reserve(const uint64_t bytes_needed, const int tag)
+/**
+ * Call the shrinkers, by priority, until "bytes_needed" bytes can be reserved.
+ * Returns true if they are reserved. Only one thread runs the shrinkers at a
+ * time ("memory_shrinking" critical section). They are called on a copy of
+ * the list, outside of the "memory_shrinkers" critical section, so they can
+ * (un)register shrinkers; one unregistered meanwhile is skipped.
+ * An allocation made by a shrinker itself does not call the shrinkers again
+ * (it would wait forever on the critical section): it gets false.
+ */
+{
+    bool reserved = false;
+    bool refused  = false;
+
+    // Counter, not shrinkers.empty(): the vector can be modified concurrently.
+    if (Atomic_Read(&nb_shrinkers) == 0 || memory_shrinking)
+        return false;
+
+    memory_shrinking = true;
+    #pragma omp critical (memory_shrinking)
+    {
+        std::vector<Memory_Shrinker_Entry> to_call;
+        #pragma omp critical (memory_shrinkers)
+        to_call = shrinkers;
+
+        // Exceptions (MEMORY_POLICY_THROW in a shrinker) must not leave
+        // the critical section: they are thrown again after it.
+        try
+        {
+            // Another thread might have freed memory while we waited.
+            reserved = Reserve_Bytes(bytes_needed, tag);
+
+            for (size_t i = 0 ; i < to_call.size() && !reserved ; i++)
+            {
+                if (!Is_Shrinker_Registered(to_call[i]))
+                    continue;
+                if (to_call[i].shrinker(bytes_needed, to_call[i].user_data) > 0)
+                    reserved = Reserve_Bytes(bytes_needed, tag);
+            }
+        }
+        catch (std::bad_alloc &)
+        {
+            refused = true;
+        }
+    }
+    memory_shrinking = false;
+
+    if (refused)
+        throw std::bad_alloc();
+
+    return reserved;
+}
+
+// **************************************************************
+bool Memory_Allocation::Recover_Over_Limit(const uint64_t bytes_needed, const int tag)
+/**
+ * For MEMORY_POLICY_CALLBACK and MEMORY_POLICY_WAIT: try to make room for
+ * "bytes_needed" bytes and reserve them. Returns true if they are reserved.
+ */
+{
+    if (over_limit_policy == MEMORY_POLICY_CALLBACK)
+    {
+        while (over_limit_callback != NULL && over_limit_callback(bytes_needed, over_limit_callback_data))
+        {
+            if (Reserve_Bytes(bytes_needed, tag))
+                return true;
+        }
+    }
+    else if (over_limit_policy == MEMORY_POLICY_WAIT)
+    {
+        // Poll every millisecond: other threads might free memory.
+        const double deadline = Wall_Clock() + over_limit_timeout;
+        struct timespec delay;
+        delay.tv_sec  = 0;
+        delay.tv_nsec = 1000000;
+        do
+        {
+            if (Reserve_Bytes(bytes_needed, tag))
+                return true;
+            nanosleep(&delay, NULL);
+        } while (Wall_Clock() < deadline);
+    }
+
+    return false;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Bytes_Allocated()
+/**
+ * With sharded counters, the global counter includes the bytes reserved
+ * (but not used) by the shards; they are only summed when asked for.
+ */
+{
+    const uint64_t global = Atomic_Read(&allocated_bytes);
+    if (shards == NULL)
+        return global;
+
+    uint64_t unused = 0;
+    for (int i = 0 ; i < nb_shards ; i++)
+        unused += Atomic_Read(&shards[i].budget);
+
+    if (unused > global)
+        return 0;
+    else
+        return global - unused;
+}
+
+// **************************************************************
+double Memory_Allocation::Get_KiBytes_Allocated()
+{
+    return Bytes_to_KiBytes(Get_Bytes_Allocated());
+}
+
+// **************************************************************
+double Memory_Allocation::Get_MiBytes_Allocated()
+{
+    return Bytes_to_MiBytes(Get_Bytes_Allocated());
+}
+
+// **************************************************************
+double Memory_Allocation::Get_GiBytes_Allocated()
+{
+    return Bytes_to_GiBytes(Get_Bytes_Allocated());
+}
+
+// **************************************************************
+void Memory_Allocation::Add_Bytes_Allocated(uint64_t to_add, const int tag)
+{
+    const uint64_t global = Atomic_Add(&allocated_bytes, to_add);
+    Record_Allocation(to_add, tag, (shards == NULL ? global : Get_Bytes_Allocated()));
+}
+
+// **************************************************************
+void Memory_Allocation::Free_Bytes_Allocated(uint64_t bytes_freed, const int tag)
+{
+    Release_Bytes(bytes_freed, tag);
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Max_Bytes()
+{
+    return max_allocated_bytes;
+}
+
+// **************************************************************
+double Memory_Allocation::Get_Max_KiBytes()
+{
+    return Bytes_to_KiBytes(max_allocated_bytes);
+}
+
+// **************************************************************
+double Memory_Allocation::Get_Max_MiBytes()
+{
+    return Bytes_to_MiBytes(max_allocated_bytes);
+}
+
+// **************************************************************
+double Memory_Allocation::Get_Max_GiBytes()
+{
+    return Bytes_to_GiBytes(max_allocated_bytes);
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Max_Bytes(uint64_t bytes)
+{
+    max_allocated_bytes = bytes;
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Max_KiBytes(double kbytes)
+{
+    max_allocated_bytes = KiBytes_to_Bytes(kbytes);
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Max_MiBytes(double mbytes)
+{
+    max_allocated_bytes = MiBytes_to_Bytes(mbytes);
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Max_GiBytes(double gbytes)
+{
+    max_allocated_bytes = GiBytes_to_Bytes(gbytes);
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Peak_Bytes()
+{
+    return Atomic_Read(&peak_bytes);
+}
+
+// **************************************************************
+void Memory_Allocation::Reset_Peak()
+{
+    peak_bytes = Get_Bytes_Allocated();
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Nb_Allocations()
+{
+    uint64_t total = 0;
+    for (int i = 0 ; i < nb_statistics ; i++)
+        total += statistics[i].nb_allocations;
+    return total;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Nb_Frees()
+{
+    uint64_t total = 0;
+    for (int i = 0 ; i < nb_statistics ; i++)
+        total += statistics[i].nb_frees;
+    return total;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Total_Bytes_Allocated()
+/**
+ * Cumulative number of bytes allocated (frees are not subtracted).
+ */
+{
+    uint64_t total = 0;
+    for (int i = 0 ; i < nb_statistics ; i++)
+        total += statistics[i].bytes_allocated;
+    return total;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Total_Bytes_Freed()
+{
+    uint64_t total = 0;
+    for (int i = 0 ; i < nb_statistics ; i++)
+        total += statistics[i].bytes_freed;
+    return total;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Size_Histogram(const int bucket)
+/**
+ * Number of allocations of [2^bucket, 2^(bucket+1)) bytes.
+ */
+{
+    uint64_t total = 0;
+    if (bucket < 0 || bucket >= memory_histogram_size)
+        return 0;
+    for (int i = 0 ; i < nb_statistics ; i++)
+        total += statistics[i].size_histogram[bucket];
+    return total;
+}
+
+// **************************************************************
+void Memory_Allocation::Sample_Rate()
+/**
+ * Keep a (time, cumulative bytes allocated) sample, but no more than
+ * memory_rate_nb_samples per window.
+ */
+{
+    const double now = Wall_Clock();
+
+    #pragma omp critical (memory_rate)
+    {
+        if (now - rate_sample_times[rate_sample_index] >= rate_window / double(memory_rate_nb_samples))
+        {
+            rate_sample_index = (rate_sample_index + 1) % memory_rate_nb_samples;
+            rate_sample_times[rate_sample_index] = now;
+            rate_sample_bytes[rate_sample_index] = Get_Total_Bytes_Allocated();
+        }
+    }
+}
+
+// **************************************************************
+double Memory_Allocation::Get_Allocation_Rate()
+/**
+ * Bytes allocated per second over (about) the last "rate_window" seconds.
+ * Samples are taken every few thousand allocations and on every call.
+ */
+{
+    if (statistics == NULL)
+        return 0.0;
+
+    Sample_Rate();
+
+    const double   now   = Wall_Clock();
+    const uint64_t bytes = Get_Total_Bytes_Allocated();
+
+    // Oldest sample still inside the window
+    double   oldest_time  = now;
+    uint64_t oldest_bytes = bytes;
+    #pragma omp critical (memory_rate)
+    {
+        for (int i = 0 ; i < memory_rate_nb_samples ; i++)
+        {
+            if (rate_sample_times[i] >= 0.0 && now - rate_sample_times[i] <= rate_window && rate_sample_times[i] < oldest_time)
+            {
+                oldest_time  = rate_sample_times[i];
+                oldest_bytes = rate_sample_bytes[i];
+            }
+        }
+    }
+
+    if (now - oldest_time <= 0.0)
+        return 0.0;
+    else
+        return double(bytes - oldest_bytes) / (now - oldest_time);
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Rate_Window(const double seconds)
+{
+    rate_window = seconds;
+}
+
+// **************************************************************
+Memory_Tag Memory_Allocation::Register_Tag(const std::string &name)
+/**
+ * Return the tag for "name", creating it if needed. Call it once per
+ * subsystem (not on every allocation): it compares strings under a lock.
+ * When MEMORY_MAX_TAGS tags exist, new names get the "untagged" tag.
+ */
+{
+    int id = -1;
+
+    #pragma omp critical (memory_tags)
+    {
+        for (int t = 0 ; t < nb_tags && id < 0 ; t++)
+        {
+            if (tag_names[t] == name)
+                id = t;
+        }
+        if (id < 0 && nb_tags < MEMORY_MAX_TAGS)
+        {
+            id = nb_tags;
+            tag_names[id] = name;
+            nb_tags++;
+        }
+    }
+
+    if (id < 0)
+    {
+        std_cout << "WARNING: Too many allocation tags (MEMORY_MAX_TAGS = " << MEMORY_MAX_TAGS << "), \"" << name << "\" will be untagged.\n";
+        id = 0;
+    }
+
+    return Memory_Tag(id);
+}
+
+// **************************************************************
+int Memory_Allocation::Get_Nb_Tags()
+{
+    return nb_tags;
+}
+
+// **************************************************************
+std::string Memory_Allocation::Get_Tag_Name(const Memory_Tag tag)
+{
+    std::string name;
+    #pragma omp critical (memory_tags)
+    {
+        if (tag.id >= 0 && tag.id < nb_tags)
+            name = tag_names[tag.id];
+    }
+    return name;
+}
+
+// **************************************************************
+int64_t Memory_Allocation::Get_Tag_Bytes(const Memory_Tag tag)
+/**
+ * Bytes currently allocated under "tag".
+ */
+{
+    uint64_t total = 0;
+    if (tag.id < 0 || tag.id >= MEMORY_MAX_TAGS)
+        return 0;
+    for (int i = 0 ; i < nb_statistics ; i++)
+        total += statistics[i].tag_bytes[tag.id];
+    return int64_t(total);
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Tag_Nb_Allocations(const Memory_Tag tag)
+{
+    uint64_t total = 0;
+    if (tag.id < 0 || tag.id >= MEMORY_MAX_TAGS)
+        return 0;
+    for (int i = 0 ; i < nb_statistics ; i++)
+        total += statistics[i].tag_nb_allocations[tag.id];
+    return total;
+}
+
+// **************************************************************
+static void Report_Live_At_Exit()
+{
+    allocated_memory.Report_Live();
+}
+
+// **************************************************************
+void Memory_Allocation::Enable_Live_Registry(const bool report_at_exit)
+/**
+ * From now on, keep a registry of all the blocks allocated by
+ * alloc_and_check() and not yet released by free_me() (pointer, size, tag and
+ * time), for leak reports (Report_Live()). Blocks allocated before are not
+ * known. Costs a hash table insertion/removal (under one of
+ * MEMORY_REGISTRY_NB_SHARDS locks) per allocation/free.
+ * Call it once (from one thread), early; it can't be disabled.
+ */
+{
+    if (live_registry != NULL)
+        return;
+
+    live_registry = new Memory_Live_Registry();
+    memory_live_registry = true;
+
+    if (report_at_exit)
+        atexit(Report_Live_At_Exit);
+}
+
+// **************************************************************
+void Memory_Allocation::Register_Live_Block(void *p, const uint64_t bytes, const int tag)
+{
+    if (live_registry != NULL)
+        live_registry->Add(p, bytes, tag);
+}
+
+// **************************************************************
+void Memory_Allocation::Unregister_Live_Block(void *p)
+{
+    if (live_registry != NULL)
+        live_registry->Remove(p);
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Nb_Live_Blocks()
+{
+    return (live_registry == NULL ? 0 : live_registry->Get_Nb_Blocks());
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Live_Block_Bytes()
+{
+    return (live_registry == NULL ? 0 : live_registry->Get_Bytes());
+}
+
+// **************************************************************
+static bool Live_Block_Order(const Memory_Live_Block &a, const Memory_Live_Block &b)
+{
+    if (a.tag != b.tag)
+        return a.tag < b.tag;
+    return a.time < b.time;
+}
+
+// **************************************************************
+void Memory_Allocation::Report_Live(const int max_blocks_per_tag)
+/**
+ * Print the outstanding (registered) blocks grouped by tag, oldest first,
+ * and the difference between the usage counter and the registered bytes:
+ * blocks registered but not freed are leaks, while a difference means an
+ * accounting gap (free_me() without the number of elements, blocks
+ * allocated before Enable_Live_Registry(), Add_Bytes_Allocated(), ...).
+ */
+{
+    if (live_registry == NULL)
+    {
+        std_cout << "Live blocks registry not enabled (see Enable_Live_Registry()).\n";
+        return;
+    }
+
+    std::vector<Memory_Live_Block> blocks;
+    live_registry->Get_Blocks(blocks);
+    std::sort(blocks.begin(), blocks.end(), Live_Block_Order);
+
+    uint64_t registered = 0;
+    for (size_t i = 0 ; i < blocks.size() ; i++)
+        registered += blocks[i].bytes;
+    const uint64_t counted = Get_Bytes_Allocated();
+
+    Print_N_Times("*", max_text_width);
+    std_cout.Format(0, 0, 'd');
+    std_cout << "Live tracked blocks: " << blocks.size() << " blocks, " << registered << " bytes\n";
+    std_cout << "Bytes counted as allocated: " << counted;
+    if (counted > registered)
+        std_cout << " (" << counted - registered << " bytes not accounted for by live blocks)";
+    else if (counted < registered)
+        std_cout << " (" << registered - counted << " bytes of live blocks already un-charged)";
+    std_cout << "\n";
+
+    size_t i = 0;
+    while (i < blocks.size())
+    {
+        const int tag = blocks[i].tag;
+        size_t end = i;
+        uint64_t bytes = 0;
+        while (end < blocks.size() && blocks[end].tag == tag)
+            bytes += blocks[end++].bytes;
+
+        std_cout << "    Tag \"" << Get_Tag_Name(Memory_Tag(tag)) << "\": " << end - i << " blocks, " << bytes << " bytes\n";
+        for (size_t b = i ; b < end && int(b - i) < max_blocks_per_tag ; b++)
+        {
+            std_cout << "        " << blocks[b].pointer << ": " << blocks[b].bytes << " bytes, allocated at ";
+            std_cout.Format(0, 6, 'g');
+            std_cout << blocks[b].time << " s\n";
+            std_cout.Format(0, 0, 'd');
+        }
+        if (int(end - i) > max_blocks_per_tag)
+            std_cout << "        ... and " << end - i - max_blocks_per_tag << " more\n";
+
+        i = end;
+    }
+    Print_N_Times("*", max_text_width);
+}
+
+// **************************************************************
+void Memory_Allocation::Register_Pool(Pool_Base *pool)
+{
+    #pragma omp critical (memory_pools)
+    pools.push_back(pool);
+}
+
+// **************************************************************
+void Memory_Allocation::Unregister_Pool(Pool_Base *pool)
+{
+    #pragma omp critical (memory_pools)
+    {
+        for (std::vector<Pool_Base *>::iterator it = pools.begin() ; it != pools.end() ; ++it)
+        {
+            if (*it == pool)
+            {
+                pools.erase(it);
+                break;
+            }
+        }
+    }
+}
+
+// **************************************************************
+void Memory_Allocation::Print()
+{
+    std_cout << "Memory allocated:       ";
+    std_cout.Format(20,0,'d');
+    std_cout    << Get_Bytes_Allocated()   << " bytes (";
+    std_cout.Format(0, 3, 'g');
+    std_cout    << Get_KiBytes_Allocated() << " KiB, "
+                << Get_MiBytes_Allocated() << " MiB, "
+                << Get_GiBytes_Allocated() << " GiB)\n";
+
+    std_cout << "Maximum memory allowed: ";
     std_cout.Format(20,0,'d');
     std_cout    << Get_Max_Bytes()   << " bytes (";
     std_cout.Format(0, 3, 'g');
     std_cout    << Get_Max_KiBytes() << " KiB, "
                 << Get_Max_MiBytes() << " MiB, "
                 << Get_Max_GiBytes() << " GiB)\n";
+
+    if (mapped_bytes != 0)
+    {
+        std_cout << "Files mapped:           ";
+        std_cout.Format(20,0,'d');
+        std_cout    << Get_Mapped_Bytes() << " bytes (";
+        std_cout.Format(0, 3, 'g');
+        std_cout    << Bytes_to_MiBytes(Get_Mapped_Bytes()) << " MiB, "
+                    << Bytes_to_GiBytes(Get_Mapped_Bytes()) << " GiB)\n";
+    }
+
+    if (Are_Counters_Sharded())
+    {
+        std_cout << "Sharded counters:       " << nb_shards << " shards, slack of ";
+        std_cout.Format(0, 0, 'd');
+        std_cout    << Get_Slack_Bytes() << " bytes\n";
+    }
+
+    if (Get_NUMA_Nb_Nodes() > 1)
+    {
+        std_cout << "Process memory per NUMA node:";
+        std_cout.Format(0, 3, 'g');
+        for (int node = 0 ; node < Get_NUMA_Nb_Nodes() ; node++)
+            std_cout << "  N" << node << ": " << Bytes_to_MiBytes(Get_NUMA_Node_Bytes(node)) << " MiB";
+        std_cout << "\n";
+    }
+
+    std_cout << "Peak memory allocated:  ";
+    std_cout.Format(20,0,'d');
+    std_cout    << Get_Peak_Bytes()   << " bytes (";
+    std_cout.Format(0, 3, 'g');
+    std_cout    << Bytes_to_KiBytes(Get_Peak_Bytes()) << " KiB, "
+                << Bytes_to_MiBytes(Get_Peak_Bytes()) << " MiB, "
+                << Bytes_to_GiBytes(Get_Peak_Bytes()) << " GiB)\n";
+
+    if (statistics != NULL)
+    {
+        std_cout.Format(0, 0, 'd');
+        std_cout    << "Allocations: " << Get_Nb_Allocations()
+                    << ", frees: " << Get_Nb_Frees()
+                    << ", total allocated: " << Get_Total_Bytes_Allocated() << " bytes\n";
+        std_cout.Format(0, 3, 'g');
+        std_cout    << "Allocation rate:        " << Bytes_to_MiBytes(uint64_t(Get_Allocation_Rate()))
+                    << " MiB/s (over the last " << rate_window << " s)\n";
+        std_cout    << "Allocation sizes (bytes: count):\n";
+        std_cout.Format(0, 0, 'd');
+        for (int b = 0 ; b < memory_histogram_size ; b++)
+        {
+            const uint64_t count = Get_Size_Histogram(b);
+            if (count != 0)
+                std_cout << "    [2^" << b << ", 2^" << b+1 << "): " << count << "\n";
+        }
+
+        std_cout << "Usage by tag (bytes, allocations):\n";
+        for (int t = 0 ; t < nb_tags ; t++)
+        {
+            const Memory_Tag tag(t);
+            if (Get_Tag_Nb_Allocations(tag) == 0)
+                continue;
+            std_cout << "    " << tag_names[t] << ": " << Get_Tag_Bytes(tag)
+                     << " bytes, " << Get_Tag_Nb_Allocations(tag) << " allocations\n";
+        }
+    }
+
+    for (size_t i = 0 ; i < pools.size() ; i++)
+    {
+        std_cout.Format(0, 0, 'd');
+        std_cout
+            << "Pool \"" << pools[i]->Get_Name() << "\": "
+            << pools[i]->Get_Nb_Live() << " live / "
+            << pools[i]->Get_Capacity() << " capacity objects of "
+            << pools[i]->Get_Object_Size() << " bytes\n";
+    }
 }
 
 // **************************************************************
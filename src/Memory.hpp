@@ -2,9 +2,11 @@
 #define INC_MEMORY_hpp
 
 #include <cstddef>  // size_t
-#include <cstdlib>  // free()
+#include <cstdlib>  // free(), posix_memalign()
+#include <cstring>  // memset()
 #include <climits> // CHAR_BIT
 #include <cmath>    // abs()
+#include <vector>
 
 #ifdef __PGI
 #include <boost/cstdint.hpp>
@@ -75,15 +77,184 @@ inline std::string Bytes_in_String(const uint64_t bytes)
 
 void Print_N_Times(const std::string x, const int N, const bool newline = true);
 
+// Branch hints and "cold" attribute, to keep the diagnostics out of the fast paths.
+#if defined(__GNUC__)
+#define MEMORY_UNLIKELY(x)  __builtin_expect(!!(x), 0)
+#define MEMORY_COLD         __attribute__((noinline, cold))
+#else // #if defined(__GNUC__)
+#define MEMORY_UNLIKELY(x)  (x)
+#define MEMORY_COLD
+#endif // #if defined(__GNUC__)
+
+// Default alignment (in bytes) of {c,m}alloc_and_check_aligned(). 64 bytes
+// is both a cache line and an AVX-512 register.
+#ifndef MEMORY_ALIGNMENT
+#define MEMORY_ALIGNMENT 64
+#endif // #ifndef MEMORY_ALIGNMENT
+
+#ifndef MEMORY_CACHE_LINE_SIZE
+#define MEMORY_CACHE_LINE_SIZE 64
+#endif // #ifndef MEMORY_CACHE_LINE_SIZE
+
+// **************************************************************
+// Index of the calling thread (OpenMP or not, of any nesting level): 0, 1,
+// 2... in the order threads first ask for it. Indices are never reused, so
+// per-thread data sized from omp_get_max_threads() must have a (shared)
+// fallback for larger indices. See Memory.cpp.
+int Memory_New_Thread_Index();
+#if defined(__GNUC__) || defined(__INTEL_COMPILER) || defined(__clang__) || defined(__PATHSCALE__)
+extern __thread int memory_thread_index;
+inline int Memory_Thread_Index()
+{
+    if (MEMORY_UNLIKELY(memory_thread_index < 0))
+        memory_thread_index = Memory_New_Thread_Index();
+    return memory_thread_index;
+}
+#else // #if defined(__GNUC__) || ...
+int Memory_Thread_Index();
+#endif // #if defined(__GNUC__) || ...
+
+// Per-thread counter, padded to a full cache line so that threads
+// charging their own shard never share a line.
+struct Memory_Shard
+{
+    uint64_t budget;    // Bytes already charged to the global counter but not yet used
+    char padding[MEMORY_CACHE_LINE_SIZE - sizeof(uint64_t)];
+};
+
+class Pool_Base;    // See Pool.hpp
+class Memory_Live_Registry;     // See Registry.hpp
+
+// Maximum number of allocation tags (see Register_Tag()), including the
+// "untagged" one.
+#ifndef MEMORY_MAX_TAGS
+#define MEMORY_MAX_TAGS 64
+#endif // #ifndef MEMORY_MAX_TAGS
+
+// Allocation category. Obtained once from allocated_memory.Register_Tag("name")
+// (which interns the name), then passed to the tagged allocation functions and
+// to free_me(): only the integer travels on the fast path.
+struct Memory_Tag
+{
+    int id;     // 0 is "untagged"
+
+    explicit Memory_Tag(const int _id = 0) : id(_id) { }
+};
+
+// Per-thread allocation statistics (see Enable_Statistics()), padded to full
+// cache lines. Only updated by their thread (without atomics), summed when
+// asked for. Threads whose Memory_Thread_Index() has no slot (beyond
+// omp_get_max_threads() when enabled) share the last one, updated atomically.
+const int memory_histogram_size = 64;   // One bucket per power of two
+struct Memory_Statistics
+{
+    uint64_t nb_allocations;
+    uint64_t nb_frees;
+    uint64_t bytes_allocated;   // Cumulative
+    uint64_t bytes_freed;       // Cumulative
+    uint64_t size_histogram[memory_histogram_size]; // Allocations of [2^i, 2^(i+1)) bytes
+    uint64_t tag_bytes[MEMORY_MAX_TAGS];            // Allocated minus freed (modulo 2^64: a thread can free another's memory)
+    uint64_t tag_nb_allocations[MEMORY_MAX_TAGS];
+    char     padding[MEMORY_CACHE_LINE_SIZE - ((4+memory_histogram_size+2*MEMORY_MAX_TAGS)*sizeof(uint64_t)) % MEMORY_CACHE_LINE_SIZE];
+};
+
+// Number of (time, cumulative bytes) samples kept to compute the allocation rate.
+const int memory_rate_nb_samples = 64;
+
+// What to do when an allocation would go over the limit. RETURN_NULL and
+// THROW also apply when the system allocation (or a file mapping) fails;
+// the other policies then abort().
+enum Memory_Over_Limit_Policy
+{
+    MEMORY_POLICY_ASK,          // Ask the user on standard input (default when it is a terminal)
+    MEMORY_POLICY_ABORT,        // Print a warning and abort() (default when not a terminal)
+    MEMORY_POLICY_CONTINUE,     // Print a warning and go over the limit
+    MEMORY_POLICY_RETURN_NULL,  // {c,m}alloc_and_check() return NULL
+    MEMORY_POLICY_THROW,        // {c,m}alloc_and_check() throw std::bad_alloc
+    MEMORY_POLICY_CALLBACK,     // Call the user callback, retry while it reports having freed memory, else abort()
+    MEMORY_POLICY_WAIT          // Retry until other threads free enough memory or the timeout expires, else abort()
+};
+
+// Callback for MEMORY_POLICY_CALLBACK: try to free (at least) "bytes_needed"
+// bytes of tracked memory. Return true if something was freed (the
+// allocation is then retried), false to give up.
+typedef bool (*Memory_Over_Limit_Callback)(const uint64_t bytes_needed, void *user_data);
+
+// "Shrinker": called under memory pressure (before applying the over limit
+// policy) to release caches. Should free up to "bytes_needed" bytes of tracked
+// memory and return how many were freed. Should not allocate tracked memory:
+// such an allocation, if over the limit, skips the shrinkers (no recursion).
+// It can unregister itself, for example when it dropped its whole cache.
+typedef uint64_t (*Memory_Shrinker)(const uint64_t bytes_needed, void *user_data);
+
+struct Memory_Shrinker_Entry
+{
+    Memory_Shrinker  shrinker;
+    void            *user_data;
+    int              priority;  // Lowest called first
+};
+
 class Memory_Allocation
 {
     private:
         uint64_t allocated_bytes;
         uint64_t max_allocated_bytes;
 
+        // Optional sharded (per-thread) counters. See Enable_Sharded_Counters().
+        Memory_Shard *shards;
+        int           nb_shards;
+        uint64_t      shard_chunk;
+
+        // Pools (see Pool.hpp) reported by Print()
+        std::vector<Pool_Base *> pools;
+
+        // Behaviour when going over the limit
+        Memory_Over_Limit_Policy    over_limit_policy;
+        Memory_Over_Limit_Callback  over_limit_callback;
+        void                       *over_limit_callback_data;
+        double                      over_limit_timeout;     // Seconds, for MEMORY_POLICY_WAIT
+
+        // Called (by priority) before going over the limit
+        std::vector<Memory_Shrinker_Entry> shrinkers;
+        uint64_t                           nb_shrinkers;   // Atomic copy of shrinkers.size()
+
+        // Statistics (see Print())
+        Memory_Statistics *statistics;
+        int                nb_statistics;
+        uint64_t           peak_bytes;
+        double             rate_window;     // Seconds
+        double             rate_sample_times[memory_rate_nb_samples];
+        uint64_t           rate_sample_bytes[memory_rate_nb_samples];
+        int                rate_sample_index;   // Index of the most recent sample
+
+        // Names of the allocation tags
+        std::string        tag_names[MEMORY_MAX_TAGS];
+        int                nb_tags;
+
+        // Optional registry of the live blocks (see Enable_Live_Registry())
+        Memory_Live_Registry *live_registry;
+
+        // Files mapped by map_file_and_check(): a separate budget, since
+        // their pages are backed by the files and not resident memory.
+        uint64_t    mapped_bytes;
+        uint64_t    max_mapped_bytes;
+
+        bool        Reserve_Global_Bytes(const uint64_t to_add, uint64_t &usage);
+        bool        Reserve_Shard_Bytes(const uint64_t to_add, uint64_t &usage);
+        void        Release_Bytes(const uint64_t bytes_freed, const int tag);
+        Memory_Shard & Current_Shard();
+        void        Record_Allocation(const uint64_t bytes, const int tag, const uint64_t usage);
+        void        Update_Peak(const uint64_t usage);
+        void        Record_Statistics(const uint64_t bytes, const int tag);
+        void        Record_Free(const uint64_t bytes, const int tag);
+        void        Sample_Rate();
+        void        Remove_Shrinker(Memory_Shrinker shrinker, void *user_data);
+        bool        Is_Shrinker_Registered(const Memory_Shrinker_Entry &entry);
+
     public:
         Memory_Allocation();
         Memory_Allocation(Memory_Allocation &other);
+        ~Memory_Allocation();
         Memory_Allocation operator=(const uint64_t right_hand_side);
         Memory_Allocation operator=(Memory_Allocation &right_hand_side);
         Memory_Allocation operator-=(Memory_Allocation &right_hand_side);
@@ -94,7 +265,18 @@ class Memory_Allocation
         Memory_Allocation operator+(Memory_Allocation &right_hand_side);
 
         bool        Under_Limit();
-        void        Verify_Limit(const bool verbose = true);
+        bool        Reserve_Bytes(const uint64_t to_add, const int tag = 0);
+        bool        Verify_Limit(const bool verbose = true);
+
+        void        Set_Over_Limit_Policy(const Memory_Over_Limit_Policy policy);
+        Memory_Over_Limit_Policy Get_Over_Limit_Policy();
+        void        Set_Over_Limit_Callback(Memory_Over_Limit_Callback callback, void *user_data = NULL);
+        void        Set_Over_Limit_Timeout(const double seconds);
+        bool        Recover_Over_Limit(const uint64_t bytes_needed, const int tag = 0);
+
+        void        Register_Shrinker(Memory_Shrinker shrinker, void *user_data = NULL, const int priority = 0);
+        void        Unregister_Shrinker(Memory_Shrinker shrinker, void *user_data = NULL);
+        bool        Shrink_And_Reserve(const uint64_t bytes_needed, const int tag = 0);
 
         uint64_t    Get_Bytes_Allocated();
         double      Get_KiBytes_Allocated();
@@ -110,8 +292,58 @@ class Memory_Allocation
         void        Set_Max_MiBytes(double mbytes);
         void        Set_Max_GiBytes(double gbytes);
 
-        void        Add_Bytes_Allocated(uint64_t to_add);
-        void        Free_Bytes_Allocated(uint64_t bytes_freed);
+        void        Add_Bytes_Allocated(uint64_t to_add, const int tag = 0);
+        void        Free_Bytes_Allocated(uint64_t bytes_freed, const int tag = 0);
+
+        void        Enable_Sharded_Counters(const uint64_t slack_bytes);
+        void        Disable_Sharded_Counters();
+        bool        Are_Counters_Sharded();
+        uint64_t    Get_Slack_Bytes();
+
+        void        Enable_Statistics();
+        void        Disable_Statistics();
+        bool        Are_Statistics_Enabled();
+        uint64_t    Get_Peak_Bytes();
+        void        Reset_Peak();
+        uint64_t    Get_Nb_Allocations();
+        uint64_t    Get_Nb_Frees();
+        uint64_t    Get_Total_Bytes_Allocated();
+        uint64_t    Get_Total_Bytes_Freed();
+        uint64_t    Get_Size_Histogram(const int bucket);
+        double      Get_Allocation_Rate();
+        void        Set_Rate_Window(const double seconds);
+
+        Memory_Tag  Register_Tag(const std::string &name);
+        int         Get_Nb_Tags();
+        std::string Get_Tag_Name(const Memory_Tag tag);
+        int64_t     Get_Tag_Bytes(const Memory_Tag tag);
+        uint64_t    Get_Tag_Nb_Allocations(const Memory_Tag tag);
+
+        int         Get_NUMA_Nb_Nodes();
+        uint64_t    Get_NUMA_Node_Bytes(const int node);
+
+        void        Set_Mmap_Threshold(const uint64_t bytes, const bool use_hugetlb = false);
+        uint64_t    Get_Mmap_Threshold();
+        uint64_t    Get_Nb_Mmap_Blocks();
+
+        void        Set_Parallel_Clear_Threshold(const uint64_t bytes);
+        uint64_t    Get_Parallel_Clear_Threshold();
+
+        bool        Reserve_Mapped_Bytes(const uint64_t bytes);
+        void        Release_Mapped_Bytes(const uint64_t bytes);
+        uint64_t    Get_Mapped_Bytes();
+        uint64_t    Get_Max_Mapped_Bytes();
+        void        Set_Max_Mapped_Bytes(const uint64_t bytes);
+
+        void        Enable_Live_Registry(const bool report_at_exit = true);
+        void        Register_Live_Block(void *p, const uint64_t bytes, const int tag);
+        void        Unregister_Live_Block(void *p);
+        uint64_t    Get_Nb_Live_Blocks();
+        uint64_t    Get_Live_Block_Bytes();
+        void        Report_Live(const int max_blocks_per_tag = 10);
+
+        void        Register_Pool(Pool_Base *pool);
+        void        Unregister_Pool(Pool_Base *pool);
 
         void        Print();
 };
@@ -185,34 +417,332 @@ inline std::string Double_in_String_Binary(double d)
 }
 // **************************************************************
 
+// **************************************************************
+#ifdef MEMORY_SIZE_HEADER
+// Compile with -DMEMORY_SIZE_HEADER ("make gcc sizeheader") to store the size
+// of every block in a small prefix, in front of the pointer returned by
+// alloc_and_check(). free_me() then un-charges the exact size without
+// needing the number of elements. Such blocks must only be released using
+// free_me() (never free()). The prefix is 16 bytes long (size and offset to
+// the real start of the block) so the returned pointer keeps malloc()'s
+// alignment; aligned blocks use a prefix as large as the alignment.
+// The allocation tag is kept in the upper half of the offset word and two
+// flags (block mmap()ed, with huge pages) in its bits 30 and 31.
+const size_t   memory_header_size    = 16;
+const uint64_t memory_header_mmap    = 0x80000000u;
+const uint64_t memory_header_hugetlb = 0x40000000u;
+
+// **************************************************************
+inline uint64_t Memory_Header_Offset(const void *p)
+{
+    return ((const uint64_t *) p)[-1] & 0x3FFFFFFFu;
+}
+
+// **************************************************************
+inline void * Memory_Block_From_Pointer(const void *p)
+{
+    return (void *) (((const char *) p) - Memory_Header_Offset(p));
+}
+
+// **************************************************************
+inline int Get_Allocation_Tag(const void *p)
+{
+    return int(((const uint64_t *) p)[-1] >> 32);
+}
+
+// **************************************************************
+inline uint64_t Get_Allocation_Size(const void *p)
+/**
+ * Number of bytes charged for the block pointed by "p".
+ */
+{
+    return ((const uint64_t *) p)[-2];
+}
+#endif // #ifdef MEMORY_SIZE_HEADER
+
+// **************************************************************
+// Hooks of the sampling profiler (see Profiler.hpp). Only called while
+// "memory_profiling" is true.
+extern bool memory_profiling;
+void Memory_Profile_Allocation(void *p, const uint64_t bytes);
+void Memory_Profile_Free(void *p);
+
+// Set by allocated_memory.Enable_Live_Registry(): every block is then
+// registered by alloc_and_check() and unregistered by free_me().
+extern bool memory_live_registry;
+
+// **************************************************************
+// Large allocations (at least "memory_mmap_threshold" bytes, 0 to disable)
+// are mmap()ed directly, with huge pages (MAP_HUGETLB if enabled and
+// available, else madvise(MADV_HUGEPAGE) for transparent huge pages) to
+// reduce TLB misses. Such memory comes zero-filled from the kernel and is
+// munmap()ed by free_me(). See Memory_Allocation::Set_Mmap_Threshold().
+#ifndef MEMORY_MMAP_THRESHOLD
+#define MEMORY_MMAP_THRESHOLD 0
+#endif // #ifndef MEMORY_MMAP_THRESHOLD
+const size_t memory_page_size = 4096;
+
+// Cleared (calloc_and_check()) blocks of at least MEMORY_PARALLEL_CLEAR_THRESHOLD
+// bytes (0: none) are malloc()ed and zeroed by all OpenMP threads using
+// non-temporal stores, instead of by calloc() on the calling thread. See
+// Memory_Allocation::Set_Parallel_Clear_Threshold().
+#ifndef MEMORY_PARALLEL_CLEAR_THRESHOLD
+#define MEMORY_PARALLEL_CLEAR_THRESHOLD 0
+#endif // #ifndef MEMORY_PARALLEL_CLEAR_THRESHOLD
+
+// Where the pages of an array go on NUMA machines (see calloc_and_check_numa()).
+enum Memory_NUMA_Placement
+{
+    MEMORY_NUMA_NONE,           // Default: wherever the pages are first touched (by calloc(), for example)
+    MEMORY_NUMA_LOCAL,          // On the node of the calling thread
+    MEMORY_NUMA_INTERLEAVE,     // Interleaved over all nodes, zeroed in parallel
+    MEMORY_NUMA_FIRST_TOUCH     // Zeroed in parallel: every OpenMP thread touches its schedule(static) chunk
+};
+void Memory_NUMA_Place(void *p, const size_t bytes, const size_t element_size, const Memory_NUMA_Placement placement);
+
+extern uint64_t memory_mmap_threshold;
+extern uint64_t memory_nb_mmap_blocks;
+void * Memory_Mmap_Allocate(const size_t bytes, bool &hugetlb);
+void   Memory_Mmap_Unmap(void *block, const size_t bytes, const bool hugetlb);
+bool   Memory_Mmap_Free(void *p);
+
+void * Memory_Raw_Reallocate(void *p, const size_t old_nb_s, const size_t new_nb_s, const size_t alignment, const int tag);
+
+extern uint64_t memory_parallel_clear_threshold;
+void Memory_Parallel_Clear(void *p, const size_t bytes);
+
+// **************************************************************
+inline void * Memory_Raw_Allocate(const size_t nb_s, const size_t alignment, const bool clear, const int tag = 0,
+                                  const Memory_NUMA_Placement placement = MEMORY_NUMA_NONE, const size_t element_size = 1)
+/**
+ * Allocate "nb_s" bytes using malloc()/calloc(), or posix_memalign() if
+ * "alignment" is not 0, or mmap() for large blocks (or with a NUMA
+ * "placement": the pages of the array of "element_size" bytes elements are
+ * then placed before the size header, if any, touches the first one).
+ * Large cleared blocks are zeroed in parallel (see Memory_Parallel_Clear()).
+ * Returns NULL on failure. No accounting is done here ("tag" is only stored
+ * in the size header, if any).
+ */
+{
+    const bool force_mmap = (placement != MEMORY_NUMA_NONE);
+
+#ifdef MEMORY_SIZE_HEADER
+    const size_t offset = (alignment > memory_header_size ? alignment : memory_header_size);
+    uint64_t flags = 0;
+#else // #ifdef MEMORY_SIZE_HEADER
+    const size_t offset = 0;
+    (void) tag;
+#endif // #ifdef MEMORY_SIZE_HEADER
+
+    // Large blocks to clear: malloc() them and zero them in parallel.
+    const bool parallel_clear = clear && MEMORY_UNLIKELY(memory_parallel_clear_threshold != 0 && nb_s >= memory_parallel_clear_threshold);
+
+    void *p = NULL;
+    if (MEMORY_UNLIKELY((force_mmap || (memory_mmap_threshold != 0 && nb_s >= memory_mmap_threshold)) && alignment <= memory_page_size))
+    {
+        // Page aligned and already zero-filled. Falls back to malloc() on failure.
+        bool hugetlb = false;
+        p = Memory_Mmap_Allocate(nb_s + offset, hugetlb);
+#ifdef MEMORY_SIZE_HEADER
+        if (p != NULL)
+            flags = memory_header_mmap | (hugetlb ? memory_header_hugetlb : 0);
+#endif // #ifdef MEMORY_SIZE_HEADER
+    }
+
+    if (p != NULL)
+    {
+        // Done
+    }
+    else if (alignment == 0)
+    {
+        if (clear && !parallel_clear)
+            p = calloc(nb_s + offset, 1);
+        else
+            p = malloc(nb_s + offset);
+        if (parallel_clear && p != NULL)
+            Memory_Parallel_Clear(p, nb_s + offset);
+    }
+    else
+    {
+        if (posix_memalign(&p, alignment, nb_s + offset) != 0)
+            p = NULL;
+        else if (parallel_clear)
+            Memory_Parallel_Clear(p, nb_s + offset);
+        else if (clear)
+            memset(p, 0, nb_s + offset);
+    }
+
+    if (MEMORY_UNLIKELY(placement != MEMORY_NUMA_NONE) && p != NULL)
+        Memory_NUMA_Place(static_cast<char *>(p) + offset, nb_s, element_size, placement);
+
+#ifdef MEMORY_SIZE_HEADER
+    if (p != NULL)
+    {
+        p = static_cast<char *>(p) + offset;
+        ((uint64_t *) p)[-2] = nb_s;
+        ((uint64_t *) p)[-1] = (uint64_t(tag) << 32) | flags | offset;
+    }
+#endif // #ifdef MEMORY_SIZE_HEADER
+
+    return p;
+}
+
+// **************************************************************
+inline void Memory_Raw_Free(void *p)
+/**
+ * Release a block from Memory_Raw_Allocate(). No accounting is done here.
+ */
+{
+#ifdef MEMORY_SIZE_HEADER
+    const uint64_t word = ((const uint64_t *) p)[-1];
+    if (MEMORY_UNLIKELY(word & memory_header_mmap))
+        Memory_Mmap_Unmap(Memory_Block_From_Pointer(p), Get_Allocation_Size(p) + Memory_Header_Offset(p), (word & memory_header_hugetlb) != 0);
+    else
+        free(Memory_Block_From_Pointer(p));
+#else // #ifdef MEMORY_SIZE_HEADER
+    // mmap()ed blocks are page aligned: only those are looked up.
+    if (MEMORY_UNLIKELY(memory_nb_mmap_blocks != 0 && (uintptr_t(p) & (memory_page_size - 1)) == 0) && Memory_Mmap_Free(p))
+        return;
+    free(p);
+#endif // #ifdef MEMORY_SIZE_HEADER
+}
+
 // **************************************************************
 template <class Pointer>
-void free_me(Pointer &p, const uint64_t nb = 0)
+void free_me(Pointer &p, const uint64_t nb = 0, const Memory_Tag tag = Memory_Tag())
+/**
+ * Free memory allocated by {c,m}alloc_and_check(). Memory allocated with a
+ * tag must be freed with the same tag (except with MEMORY_SIZE_HEADER, where
+ * both the size and the tag are read from the header).
+ */
 {
     if (p != NULL)
     {
+        if (MEMORY_UNLIKELY(memory_profiling))
+            Memory_Profile_Free(p);
+        if (MEMORY_UNLIKELY(memory_live_registry))
+            allocated_memory.Unregister_Live_Block(p);
+
+#ifdef MEMORY_SIZE_HEADER
+        // Remove bytes from allocated memory count (as stored in the header)
+        (void) tag;
+        allocated_memory.Free_Bytes_Allocated(Get_Allocation_Size(p), Get_Allocation_Tag(p));
+
+        // Free memory
+        Memory_Raw_Free(p);
+#else // #ifdef MEMORY_SIZE_HEADER
         // Remove bytes from allocated memory count
-        allocated_memory -= nb * sizeof(p[0]);
+        allocated_memory.Free_Bytes_Allocated(nb * sizeof(p[0]), tag.id);
 
         // Free memory
-        free(p);
+        Memory_Raw_Free(p);
+#endif // #ifdef MEMORY_SIZE_HEADER
     }
     p = NULL;
 }
 
 // **************************************************************
 template <class Pointer>
-void free_me_size(Pointer &p, const size_t size_to_remove)
+void free_me_size(Pointer &p, const size_t size_to_remove, const Memory_Tag tag = Memory_Tag())
 {
+#ifdef MEMORY_SIZE_HEADER
+    // The size and tag are known from the header.
+    (void) size_to_remove;
+    free_me(p, 0, tag);
+#else // #ifdef MEMORY_SIZE_HEADER
     if (p != NULL)
     {
+        if (MEMORY_UNLIKELY(memory_profiling))
+            Memory_Profile_Free(p);
+        if (MEMORY_UNLIKELY(memory_live_registry))
+            allocated_memory.Unregister_Live_Block(p);
+
         // Remove bytes from allocated memory count
-        allocated_memory -= size_to_remove;
+        allocated_memory.Free_Bytes_Allocated(size_to_remove, tag.id);
 
         // Free memory
-        free(p);
+        Memory_Raw_Free(p);
     }
     p = NULL;
+#endif // #ifdef MEMORY_SIZE_HEADER
+}
+
+// **************************************************************
+// How map_file_and_check() opens the file.
+enum Memory_File_Mode
+{
+    MEMORY_FILE_READ,           // Existing file, read only (writing to the array crashes)
+    MEMORY_FILE_READ_WRITE,     // Created if needed, extended (with zeros) if too small
+    MEMORY_FILE_CREATE          // Created or truncated, then sized (zeros)
+};
+
+// Access pattern hints for mapped files (madvise()).
+enum Memory_File_Advice
+{
+    MEMORY_FILE_NORMAL,
+    MEMORY_FILE_SEQUENTIAL,     // Aggressive read-ahead, pages dropped soon after being read
+    MEMORY_FILE_RANDOM,         // No read-ahead
+    MEMORY_FILE_WILLNEED,       // Start reading the range now (prefetch)
+    MEMORY_FILE_DONTNEED        // Range not needed anymore (dirty pages are msync()ed first, then dropped from the process)
+};
+
+// See Mapped.cpp
+void * Memory_Map_File(const char *filename, const uint64_t bytes, const Memory_File_Mode mode, const char *msg);
+void   Memory_Unmap_File(const void *p, const uint64_t bytes);
+bool   Memory_Sync_File(const void *p, const uint64_t bytes, const bool wait);
+void   Memory_Advise_File(const void *p, const uint64_t bytes, const Memory_File_Advice advice);
+
+// **************************************************************
+template <class T, class Integer>
+inline T* map_file_and_check(const std::string &filename, Integer nb, const Memory_File_Mode mode = MEMORY_FILE_READ_WRITE, const char *msg = "")
+/**
+ * Map "nb" elements of type T of the file "filename" (from its start,
+ * MAP_SHARED: writes go to the file). The array can then be used like one
+ * from malloc_and_check(), the OS page cache doing the I/O, so it can be
+ * larger than the RAM. Its bytes count in the "mapped" budget (see
+ * Set_Max_Mapped_Bytes()), not in the allocated memory.
+ * On failure, returns NULL or throws according to the over limit policy
+ * (MEMORY_POLICY_RETURN_NULL or MEMORY_POLICY_THROW), else aborts.
+ * Unmap with unmap_file().
+ */
+{
+    return static_cast<T *>(Memory_Map_File(filename.c_str(), uint64_t(nb) * sizeof(T), mode, msg));
+}
+
+// **************************************************************
+template <class Pointer>
+void unmap_file(Pointer &p, const uint64_t nb)
+/**
+ * Unmap an array from map_file_and_check() of "nb" elements. Dirty pages
+ * are written back to the file by the OS later (see sync_mapped_file()).
+ */
+{
+    if (p != NULL)
+        Memory_Unmap_File(p, nb * sizeof(p[0]));
+    p = NULL;
+}
+
+// **************************************************************
+template <class T>
+bool sync_mapped_file(T *p, const uint64_t nb, const bool wait = true)
+/**
+ * Write back the modified pages of the first "nb" elements of a mapped
+ * array (msync()), waiting for the writes to complete if "wait".
+ */
+{
+    return Memory_Sync_File(p, nb * sizeof(T), wait);
+}
+
+// **************************************************************
+template <class T>
+void advise_mapped_file(T *p, const uint64_t first, const uint64_t nb, const Memory_File_Advice advice)
+/**
+ * Hint the kernel about how the elements [first, first+nb) of a mapped
+ * array will be accessed, for example MEMORY_FILE_WILLNEED on the next
+ * chunk while working on the current one.
+ */
+{
+    Memory_Advise_File(p + first, nb * sizeof(T), advice);
 }
 
 // **************************************************************
@@ -268,117 +798,66 @@ std::string Integer_in_String_Binary(Integer n)
     return integer_in_binary;
 }
 
+// **************************************************************
+// Out of line (cold) parts of alloc_and_check(); see Memory.cpp.
+MEMORY_COLD bool Memory_Over_Limit(const uint64_t nb, const size_t s, const char *msg, const int tag = 0);
+MEMORY_COLD void Memory_Allocation_Failed(const uint64_t nb, const size_t s, const size_t alignment, const char *msg, const int tag = 0);
+
 // **************************************************************
 template <class T, class Integer>
-T* alloc_and_check(Integer nb, const bool clear = false, const std::string &msg = "")
+inline T* alloc_and_check(Integer nb, const bool clear = false, const char *msg = "", const size_t alignment = 0, const int tag = 0,
+                          const Memory_NUMA_Placement placement = MEMORY_NUMA_NONE)
 /**
  * Template for memory allocation.
  *  -Check that memory is not above a certain threshold.
  *  -Verify that memory allocation succeed
+ * If "alignment" is not 0 (must then be a power of two multiple of
+ * sizeof(void *)), the returned pointer is aligned on that many bytes.
+ * The bytes are charged to the allocation tag "tag" (see Register_Tag()).
+ * With a NUMA "placement", the block is mmap()ed and its pages placed
+ * before being touched (the memory is then always zeroed).
+ * Only the fast path is inlined: the diagnostics are in cold functions
+ * and "msg" is only used by them.
  */
 {
-    const int _max_text_width = 97;
+    const size_t nb_s = size_t(nb) * sizeof(T);
 
-    const size_t s = sizeof(T);
-    const size_t nb_s = nb * s;
-
-    T *p = NULL;
-
-    Memory_Allocation mem_temp = allocated_memory;
-
-    mem_temp += nb_s;
-
-    if (!mem_temp.Under_Limit())
+    // Reserve the bytes (atomically) before the real allocation so that
+    // concurrent threads cannot all pass the limit check at the same time.
+    // Over the limit, the policy (see Memory_Over_Limit_Policy) decides if we
+    // continue, return NULL, throw or abort.
+    if (MEMORY_UNLIKELY(!allocated_memory.Reserve_Bytes(nb_s, tag)))
     {
-        Print_N_Times("#", _max_text_width);
-        std_cout
-            << "WARNING!!!\n    "
-            << "Trying to allocate:           ";
-        std_cout.Format(20,0,'d');
-        std_cout << nb << " x " << s << " bytes = " << nb_s << " bytes\n";
-        std_cout << "                                               (";
-        std_cout.Format(0, 3, 'g');
-        std_cout
-            << Bytes_to_KiBytes(nb_s) << " KiB, "
-            << Bytes_to_MiBytes(nb_s) << " MiB, "
-            << Bytes_to_GiBytes(nb_s) << " GiB)\n    "
-            << "but memory will be over the limit:\n";
-        std_cout << "                   ";
-        std_cout.Format(20,0,'d');
-        std_cout
-            << allocated_memory.Get_Max_Bytes() << " bytes, (";
-        std_cout.Format(0, 3, 'g');
-        std_cout
-            << allocated_memory.Get_Max_KiBytes() << " KiB, "
-            << allocated_memory.Get_Max_MiBytes() << " MiB, "
-            << allocated_memory.Get_Max_GiBytes() << " GiB)\n    "
-            << "Current usage: ";
-        std_cout.Format(20,0,'d');
-        std_cout
-            << allocated_memory.Get_Bytes_Allocated() << " bytes, (";
-        std_cout.Format(0, 3, 'g');
-        std_cout
-            << allocated_memory.Get_KiBytes_Allocated() << " KiB, "
-            << allocated_memory.Get_MiBytes_Allocated() << " MiB, "
-            << allocated_memory.Get_GiBytes_Allocated() << " GiB)\n    "
-            << "Wanted usage:  ";
-        std_cout.Format(20,0,'d');
-        std_cout
-            << mem_temp.Get_Bytes_Allocated() << " bytes, (";
-        std_cout.Format(0, 3, 'g');
-        std_cout
-            << mem_temp.Get_KiBytes_Allocated() << " KiB, "
-            << mem_temp.Get_MiBytes_Allocated() << " MiB, "
-            << mem_temp.Get_GiBytes_Allocated() << " GiB)\n";
-        if (msg != "")
-        {
-            std_cout << "    Comment: " << msg << std::endl;
-        }
-
-        std::string answer = MemPause("Are you sure you want to continue? [y,N]");
-        std_cout << std::flush;
-        if ( ! (answer == "y" || answer == "Y"))
-        {
-            std_cout << "Exiting.\n" << std::flush;
-            abort();
-        }
-        std_cout << "Continuing..." << std::endl << std::flush;
+        if (!Memory_Over_Limit(uint64_t(nb), sizeof(T), msg, tag))
+            return NULL;
     }
 
-    if (clear)
-        p = static_cast<T *>(calloc(nb, s));
-    else
-        p = static_cast<T *>(malloc(nb_s));
+    T *p = static_cast<T *>(Memory_Raw_Allocate(nb_s, alignment, clear, tag, placement, sizeof(T)));
 
-    if (p == NULL)
+    if (MEMORY_UNLIKELY(p == NULL))
     {
-        std_cout << "ERROR!!!\n";
-        std_cout << "    Allocation of ";
-        std_cout.Format(20,0,'d');
-        std_cout << nb << " x " << s << " bytes = " << nb_s << " bytes\n";
-        std_cout << "                                               (";
-        std_cout.Format(0, 3, 'g');
-        std_cout
-            << Bytes_to_KiBytes(nb_s) << " KiB, "
-            << Bytes_to_MiBytes(nb_s) << " MiB, "
-            << Bytes_to_GiBytes(nb_s) << " GiB)\n"
-            << "    FAILED!!!\n";
-        if (msg != "")
-        {
-            std_cout << "Comment: " << msg << std::endl;
-        }
-        std_cout << "Aborting.\n" << std::flush;
-        abort();
+        Memory_Allocation_Failed(uint64_t(nb), sizeof(T), alignment, msg, tag);
+        return NULL;
     }
 
-    allocated_memory += nb_s;
+    if (MEMORY_UNLIKELY(memory_profiling))
+        Memory_Profile_Allocation(p, nb_s);
+    if (MEMORY_UNLIKELY(memory_live_registry))
+        allocated_memory.Register_Live_Block(p, nb_s, tag);
 
     return p;
 }
 
 // **************************************************************
 template <class T, class Integer>
-T* calloc_and_check(Integer nb, const std::string &msg = "")
+inline T* alloc_and_check(Integer nb, const bool clear, const std::string &msg, const size_t alignment = 0)
+{
+    return alloc_and_check<T, Integer>(nb, clear, msg.c_str(), alignment);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* calloc_and_check(Integer nb, const char *msg = "")
 /**
  * Template normally used: wrapper around alloc_and_check<T, Integer>()
  */
@@ -388,7 +867,14 @@ T* calloc_and_check(Integer nb, const std::string &msg = "")
 
 // **************************************************************
 template <class T, class Integer>
-T* malloc_and_check(Integer nb, const std::string &msg = "")
+inline T* calloc_and_check(Integer nb, const std::string &msg)
+{
+    return alloc_and_check<T, Integer>(nb, true, msg.c_str());
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* malloc_and_check(Integer nb, const char *msg = "")
 /**
  * Template normally used: wrapper around alloc_and_check<T, Integer>()
  */
@@ -396,9 +882,166 @@ T* malloc_and_check(Integer nb, const std::string &msg = "")
     return alloc_and_check<T, Integer>(nb, false, msg);
 }
 
+// **************************************************************
+template <class T, class Integer>
+inline T* malloc_and_check(Integer nb, const std::string &msg)
+{
+    return alloc_and_check<T, Integer>(nb, false, msg.c_str());
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* calloc_and_check_aligned(Integer nb, const char *msg = "", const size_t alignment = MEMORY_ALIGNMENT)
+/**
+ * Zeroed allocation aligned on "alignment" bytes (default: MEMORY_ALIGNMENT),
+ * for SIMD data. Release with free_me() as usual.
+ */
+{
+    return alloc_and_check<T, Integer>(nb, true, msg, alignment);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* calloc_and_check_aligned(Integer nb, const std::string &msg, const size_t alignment = MEMORY_ALIGNMENT)
+{
+    return alloc_and_check<T, Integer>(nb, true, msg.c_str(), alignment);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* malloc_and_check_aligned(Integer nb, const char *msg = "", const size_t alignment = MEMORY_ALIGNMENT)
+/**
+ * Allocation aligned on "alignment" bytes (default: MEMORY_ALIGNMENT),
+ * for SIMD data. Release with free_me() as usual.
+ */
+{
+    return alloc_and_check<T, Integer>(nb, false, msg, alignment);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* malloc_and_check_aligned(Integer nb, const std::string &msg, const size_t alignment = MEMORY_ALIGNMENT)
+{
+    return alloc_and_check<T, Integer>(nb, false, msg.c_str(), alignment);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* calloc_and_check(Integer nb, const Memory_Tag tag)
+/**
+ * Tagged allocations: the bytes are accounted for under "tag" (see
+ * Register_Tag()), whose name is used as the message. Free with
+ * free_me(p, nb, tag).
+ */
+{
+    return alloc_and_check<T, Integer>(nb, true, "", 0, tag.id);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* malloc_and_check(Integer nb, const Memory_Tag tag)
+{
+    return alloc_and_check<T, Integer>(nb, false, "", 0, tag.id);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* calloc_and_check_aligned(Integer nb, const Memory_Tag tag, const size_t alignment = MEMORY_ALIGNMENT)
+{
+    return alloc_and_check<T, Integer>(nb, true, "", alignment, tag.id);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* malloc_and_check_aligned(Integer nb, const Memory_Tag tag, const size_t alignment = MEMORY_ALIGNMENT)
+{
+    return alloc_and_check<T, Integer>(nb, false, "", alignment, tag.id);
+}
+
+// **************************************************************
+template <class T, class Integer>
+inline T* calloc_and_check_numa(Integer nb, const Memory_NUMA_Placement placement, const char *msg = "", const Memory_Tag tag = Memory_Tag())
+/**
+ * Zeroed, page aligned allocation whose pages are placed on the NUMA nodes
+ * according to "placement". With MEMORY_NUMA_FIRST_TOUCH, use the array
+ * from "#pragma omp for schedule(static)" loops over its elements so that
+ * every thread works on the pages of its own node. Release with free_me().
+ */
+{
+    return alloc_and_check<T, Integer>(nb, true, msg, 0, tag.id, placement);
+}
+
+// **************************************************************
+template <class T, class Integer>
+T* realloc_and_check(T *p, Integer old_nb, Integer new_nb, const char *msg = "", const Memory_Tag tag = Memory_Tag(), const size_t alignment = 0)
+/**
+ * Resize the array "p" of "old_nb" elements (from {c,m}alloc_and_check())
+ * to "new_nb" elements, keeping its content; the new elements are not
+ * initialized. Only the difference is charged or given back, and large
+ * mmap()ed blocks grow without copy (mremap()). Returns the (possibly
+ * moved) array. "p" can be NULL (then allocates) and "new_nb" 0 (then frees).
+ * "tag" must be the one used for the allocation; so must "alignment", for
+ * aligned arrays, unless MEMORY_SIZE_HEADER is used (then the size, tag and
+ * alignment are read from the header).
+ * If the growth is refused (see Memory_Over_Limit_Policy), returns NULL and
+ * "p" is left unchanged, like realloc().
+ */
+{
+    if (p == NULL)
+        return alloc_and_check<T, Integer>(new_nb, false, msg, alignment, tag.id);
+    if (new_nb == 0)
+    {
+        free_me(p, uint64_t(old_nb), tag);
+        return NULL;
+    }
+
+#ifdef MEMORY_SIZE_HEADER
+    const size_t old_nb_s = size_t(Get_Allocation_Size(p));
+    const int    tag_id   = Get_Allocation_Tag(p);
+#else // #ifdef MEMORY_SIZE_HEADER
+    const size_t old_nb_s = size_t(old_nb) * sizeof(T);
+    const int    tag_id   = tag.id;
+#endif // #ifdef MEMORY_SIZE_HEADER
+    const size_t new_nb_s = size_t(new_nb) * sizeof(T);
+
+    if (new_nb_s > old_nb_s && MEMORY_UNLIKELY(!allocated_memory.Reserve_Bytes(new_nb_s - old_nb_s, tag_id)))
+    {
+        if (!Memory_Over_Limit(uint64_t(new_nb_s - old_nb_s), 1, msg, tag_id))
+            return NULL;
+    }
+
+    if (MEMORY_UNLIKELY(memory_profiling))
+        Memory_Profile_Free(p);
+    if (MEMORY_UNLIKELY(memory_live_registry))
+        allocated_memory.Unregister_Live_Block(p);
+
+    T *new_p = static_cast<T *>(Memory_Raw_Reallocate(p, old_nb_s, new_nb_s, alignment, tag_id));
+
+    if (MEMORY_UNLIKELY(new_p == NULL))
+    {
+        // Only a growth can fail, and "p" is then still valid.
+        if (MEMORY_UNLIKELY(memory_profiling))
+            Memory_Profile_Allocation(p, old_nb_s);
+        if (MEMORY_UNLIKELY(memory_live_registry))
+            allocated_memory.Register_Live_Block(p, old_nb_s, tag_id);
+        Memory_Allocation_Failed(uint64_t(new_nb_s - old_nb_s), 1, alignment, msg, tag_id);
+        return NULL;
+    }
+
+    if (new_nb_s < old_nb_s)
+        allocated_memory.Free_Bytes_Allocated(old_nb_s - new_nb_s, tag_id);
+
+    if (MEMORY_UNLIKELY(memory_profiling))
+        Memory_Profile_Allocation(new_p, new_nb_s);
+    if (MEMORY_UNLIKELY(memory_live_registry))
+        allocated_memory.Register_Live_Block(new_p, new_nb_s, tag_id);
+
+    return new_p;
+}
+
 // **************************************************************
 template <class Integer>
-void * alloc_and_check(Integer nb, size_t s, const bool clear = false, const std::string &msg = "")
+void * alloc_and_check(Integer nb, size_t s, const bool clear = false, const char *msg = "")
 /**
  * For backward compatibility.
  */
@@ -421,6 +1064,47 @@ void * alloc_and_check(Integer nb, size_t s, const bool clear = false, const std
     return p;
 }
 
+// **************************************************************
+template <class Integer>
+void * alloc_and_check(Integer nb, size_t s, const bool clear, const std::string &msg)
+{
+    return alloc_and_check<Integer>(nb, s, clear, msg.c_str());
+}
+
+// **************************************************************
+template <class Integer>
+void * calloc_and_check(Integer nb, size_t s, const char *msg = "")
+/**
+ * For backward compatibility: same calling convention as malloc_and_check(nb, s).
+ */
+{
+    return alloc_and_check<Integer>(nb, s, true, msg);
+}
+
+// **************************************************************
+template <class Integer>
+void * calloc_and_check(Integer nb, size_t s, const std::string &msg)
+{
+    return alloc_and_check<Integer>(nb, s, true, msg.c_str());
+}
+
+// **************************************************************
+template <class Integer>
+void * malloc_and_check(Integer nb, size_t s, const char *msg = "")
+/**
+ * For backward compatibility: same calling convention as calloc_and_check(nb, s).
+ */
+{
+    return alloc_and_check<Integer>(nb, s, false, msg);
+}
+
+// **************************************************************
+template <class Integer>
+void * malloc_and_check(Integer nb, size_t s, const std::string &msg)
+{
+    return alloc_and_check<Integer>(nb, s, false, msg.c_str());
+}
+
 // **************************************************************
 template <class T>
 bool Are_Values_Close(const T val1, const T val2, const double tolerance)
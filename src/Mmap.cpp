@@ -0,0 +1,251 @@
+// **************************************************************
+//              mmap() path for large allocations
+// **************************************************************
+
+#include <map>
+#include <cstring>      // memcpy()
+#include <sys/mman.h>   // mmap(), munmap(), madvise(), mremap()
+
+#include "Memory.hpp"
+
+uint64_t memory_mmap_threshold  = MEMORY_MMAP_THRESHOLD;
+uint64_t memory_nb_mmap_blocks  = 0;
+static bool memory_mmap_hugetlb = false;
+
+// Huge page size used with MAP_HUGETLB (the default one on x86-64).
+const size_t memory_huge_page_size = 2097152;
+
+#ifndef MEMORY_SIZE_HEADER
+// Without the size header, the mapped length of every mmap()ed block is kept
+// here (there are few of them since they are large).
+static std::map<void *, size_t> memory_mmap_blocks;
+#endif // #ifndef MEMORY_SIZE_HEADER
+
+// **************************************************************
+static inline size_t Round_Up(const size_t bytes, const size_t multiple)
+{
+    return (bytes + multiple - 1) / multiple * multiple;
+}
+
+// **************************************************************
+void * Memory_Mmap_Allocate(const size_t bytes, bool &hugetlb)
+/**
+ * Map "bytes" bytes of anonymous (zero-filled) memory. "hugetlb" tells if
+ * explicit huge pages were used. Returns NULL on failure.
+ */
+{
+    void *p = MAP_FAILED;
+    hugetlb = false;
+
+#ifdef MAP_HUGETLB
+    if (memory_mmap_hugetlb)
+    {
+        // Needs huge pages reserved by the administrator (vm.nr_hugepages).
+        p = mmap(NULL, Round_Up(bytes, memory_huge_page_size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        hugetlb = (p != MAP_FAILED);
+    }
+#endif // #ifdef MAP_HUGETLB
+
+    if (p == MAP_FAILED)
+    {
+        p = mmap(NULL, Round_Up(bytes, memory_page_size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        // Transparent huge pages; only a hint.
+        madvise(p, Round_Up(bytes, memory_page_size), MADV_HUGEPAGE);
+#endif // #ifdef MADV_HUGEPAGE
+    }
+
+    #pragma omp critical (memory_mmap)
+    {
+#ifndef MEMORY_SIZE_HEADER
+        memory_mmap_blocks[p] = Round_Up(bytes, (hugetlb ? memory_huge_page_size : memory_page_size));
+#endif // #ifndef MEMORY_SIZE_HEADER
+        memory_nb_mmap_blocks++;
+    }
+
+    return p;
+}
+
+// **************************************************************
+void Memory_Mmap_Unmap(void *block, const size_t bytes, const bool hugetlb)
+/**
+ * Unmap a block of "bytes" bytes from Memory_Mmap_Allocate().
+ */
+{
+    munmap(block, Round_Up(bytes, (hugetlb ? memory_huge_page_size : memory_page_size)));
+
+    #pragma omp critical (memory_mmap)
+    {
+        memory_nb_mmap_blocks--;
+    }
+}
+
+// **************************************************************
+bool Memory_Mmap_Free(void *p)
+/**
+ * Unmap "p" if it is an mmap()ed block (without the size header). Returns
+ * false if it is not one.
+ */
+{
+#ifdef MEMORY_SIZE_HEADER
+    (void) p;
+    return false;
+#else // #ifdef MEMORY_SIZE_HEADER
+    size_t length = 0;
+    #pragma omp critical (memory_mmap)
+    {
+        std::map<void *, size_t>::iterator it = memory_mmap_blocks.find(p);
+        if (it != memory_mmap_blocks.end())
+        {
+            length = it->second;
+            memory_mmap_blocks.erase(it);
+            memory_nb_mmap_blocks--;
+        }
+    }
+
+    if (length == 0)
+        return false;
+
+    munmap(p, length);
+    return true;
+#endif // #ifdef MEMORY_SIZE_HEADER
+}
+
+// **************************************************************
+static void * Remap(void *block, const size_t old_length, const size_t new_length)
+/**
+ * Resize a mapping, moving it (without copying: only the page tables change)
+ * if it cannot grow in place. Returns NULL on failure.
+ */
+{
+#ifdef MREMAP_MAYMOVE
+    void *p = mremap(block, old_length, new_length, MREMAP_MAYMOVE);
+    return (p == MAP_FAILED ? NULL : p);
+#else // #ifdef MREMAP_MAYMOVE
+    (void) block; (void) old_length; (void) new_length;
+    return NULL;
+#endif // #ifdef MREMAP_MAYMOVE
+}
+
+// **************************************************************
+void * Memory_Raw_Reallocate(void *p, const size_t old_nb_s, const size_t new_nb_s, const size_t alignment, const int tag)
+/**
+ * Resize the block "p" from Memory_Raw_Allocate() to "new_nb_s" bytes,
+ * keeping its content (up to the smallest size). mmap()ed blocks are
+ * mremap()ed, heap blocks realloc()ed; a heap block growing over the mmap
+ * threshold is moved (copied) to an mmap()ed block once. Aligned blocks
+ * ("alignment" not 0) are copied to a new aligned block.
+ * Returns NULL on failure ("p" is then still valid). No accounting is done here.
+ */
+{
+    const bool to_mmap = (memory_mmap_threshold != 0 && new_nb_s >= memory_mmap_threshold && alignment <= memory_page_size);
+
+#ifdef MEMORY_SIZE_HEADER
+    const uint64_t word   = ((const uint64_t *) p)[-1];
+    const size_t   offset = size_t(Memory_Header_Offset(p));
+    char *block           = static_cast<char *>(Memory_Block_From_Pointer(p));
+    void *new_block       = NULL;
+
+    if (word & memory_header_mmap)
+    {
+        // Huge pages (MAP_HUGETLB) mappings are copied.
+        if (!(word & memory_header_hugetlb))
+            new_block = Remap(block, Round_Up(old_nb_s + offset, memory_page_size), Round_Up(new_nb_s + offset, memory_page_size));
+    }
+    else if (!to_mmap && alignment == 0 && offset == memory_header_size)
+    {
+        new_block = realloc(block, new_nb_s + offset);
+        if (new_block == NULL && new_nb_s > old_nb_s)
+            return NULL;
+        if (new_block == NULL)
+            new_block = block;  // Could not shrink: keep the larger block
+    }
+
+    if (new_block != NULL)
+    {
+        p = static_cast<char *>(new_block) + offset;
+        ((uint64_t *) p)[-2] = new_nb_s;
+        return p;
+    }
+    (void) tag;
+    const size_t new_alignment = (alignment != 0 ? alignment : (offset > memory_header_size ? offset : 0));
+    const int    new_tag       = Get_Allocation_Tag(p);
+#else // #ifdef MEMORY_SIZE_HEADER
+    // mmap()ed blocks (page aligned) are in memory_mmap_blocks.
+    size_t length = 0;
+    if (memory_nb_mmap_blocks != 0 && (uintptr_t(p) & (memory_page_size - 1)) == 0)
+    {
+        #pragma omp critical (memory_mmap)
+        {
+            std::map<void *, size_t>::iterator it = memory_mmap_blocks.find(p);
+            if (it != memory_mmap_blocks.end())
+                length = it->second;
+        }
+    }
+
+    if (length != 0)
+    {
+        void *new_block = Remap(p, length, Round_Up(new_nb_s, memory_page_size));
+        if (new_block != NULL)
+        {
+            #pragma omp critical (memory_mmap)
+            {
+                memory_mmap_blocks.erase(p);
+                memory_mmap_blocks[new_block] = Round_Up(new_nb_s, memory_page_size);
+            }
+            return new_block;
+        }
+    }
+    else if (!to_mmap && alignment == 0)
+    {
+        void *new_block = realloc(p, new_nb_s);
+        if (new_block == NULL && new_nb_s > old_nb_s)
+            return NULL;
+        return (new_block == NULL ? p : new_block);
+    }
+    const size_t new_alignment = alignment;
+    const int    new_tag       = tag;
+#endif // #ifdef MEMORY_SIZE_HEADER
+
+    // Copy to a new block
+    void *new_p = Memory_Raw_Allocate(new_nb_s, new_alignment, false, new_tag);
+    if (new_p == NULL)
+    {
+        if (new_nb_s > old_nb_s)
+            return NULL;
+        return p;
+    }
+    memcpy(new_p, p, (old_nb_s < new_nb_s ? old_nb_s : new_nb_s));
+    Memory_Raw_Free(p);
+
+    return new_p;
+}
+
+// **************************************************************
+void Memory_Allocation::Set_Mmap_Threshold(const uint64_t bytes, const bool use_hugetlb)
+/**
+ * Allocations of at least "bytes" bytes (0: none) will be mmap()ed, using
+ * explicit huge pages (MAP_HUGETLB) if "use_hugetlb" and some are available,
+ * transparent huge pages otherwise. Blocks already allocated are not affected.
+ * Default: MEMORY_MMAP_THRESHOLD (0, can be set at compile time).
+ */
+{
+    memory_mmap_threshold = bytes;
+    memory_mmap_hugetlb   = use_hugetlb;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Mmap_Threshold()
+{
+    return memory_mmap_threshold;
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_Nb_Mmap_Blocks()
+{
+    return memory_nb_mmap_blocks;
+}
+
+// ********** End of file ***************************************
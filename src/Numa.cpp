@@ -0,0 +1,183 @@
+// **************************************************************
+//              NUMA placement and per-node usage
+// **************************************************************
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>         // syscall()
+#include <sys/syscall.h>    // SYS_mbind, SYS_getcpu
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif // #ifdef _OPENMP
+
+#include "Memory.hpp"
+
+// Memory policies of mbind(2) (see <numaif.h>, not used to avoid depending on libnuma)
+const int memory_mpol_preferred  = 1;
+const int memory_mpol_interleave = 3;
+
+// Bits in the node masks given to mbind()
+const int memory_numa_max_nodes = 1024;
+const int memory_numa_mask_size = memory_numa_max_nodes / (8 * sizeof(unsigned long));
+
+// **************************************************************
+static int NUMA_Nb_Nodes()
+/**
+ * Number of NUMA nodes (from "/sys/devices/system/node/possible", e.g. "0-1").
+ */
+{
+    static int nb_nodes = 0;
+    if (nb_nodes != 0)
+        return nb_nodes;
+
+    int last = 0;
+    std::ifstream possible("/sys/devices/system/node/possible");
+    std::string range;
+    if (possible >> range)
+    {
+        const size_t separator = range.find_last_of("-,");
+        last = atoi(range.substr(separator == std::string::npos ? 0 : separator + 1).c_str());
+    }
+    nb_nodes = (last + 1 > memory_numa_max_nodes ? memory_numa_max_nodes : last + 1);
+
+    return nb_nodes;
+}
+
+// **************************************************************
+static int NUMA_Current_Node()
+{
+#ifdef SYS_getcpu
+    unsigned int cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+        return int(node);
+#endif // #ifdef SYS_getcpu
+    return 0;
+}
+
+// **************************************************************
+static void NUMA_Bind(void *start, const size_t length, const int mode, const unsigned long *mask)
+/**
+ * Set the policy of the pages in [start, start+length) (page aligned) for
+ * when they will be touched. Failures (kernel without NUMA) are ignored.
+ */
+{
+#ifdef SYS_mbind
+    syscall(SYS_mbind, start, length, mode, mask, (unsigned long) (memory_numa_max_nodes + 1), 0);
+#else // #ifdef SYS_mbind
+    (void) start; (void) length; (void) mode; (void) mask;
+#endif // #ifdef SYS_mbind
+}
+
+// **************************************************************
+static void Touch_Pages(char *begin, char *end)
+/**
+ * Write (zeros, so the content does not change) to every page of
+ * [begin, end): the pages are then allocated by the calling thread.
+ */
+{
+    volatile char *p = begin;
+    for ( ; p < (volatile char *) end ; p += memory_page_size)
+        *p = 0;
+    if (end > begin)
+        *((volatile char *) end - 1) = 0;
+}
+
+// **************************************************************
+void Memory_NUMA_Place(void *p, const size_t bytes, const size_t element_size, const Memory_NUMA_Placement placement)
+/**
+ * Place the (not yet touched, mmap()ed) pages of the array "p" of "bytes"
+ * bytes. Best effort: if the block had to be malloc()ed, its pages might
+ * already be placed.
+ */
+{
+    if (p == NULL || bytes == 0)
+        return;
+
+    char *begin = static_cast<char *>(p);
+    char *end   = begin + bytes;
+
+    // Page range covering the array
+    char *first_page = (char *) (uintptr_t(begin) & ~uintptr_t(memory_page_size - 1));
+    char *last_page  = (char *) ((uintptr_t(end) + memory_page_size - 1) & ~uintptr_t(memory_page_size - 1));
+
+    unsigned long mask[memory_numa_mask_size];
+    memset(mask, 0, sizeof(mask));
+
+    if (placement == MEMORY_NUMA_LOCAL)
+    {
+        const int node = NUMA_Current_Node();
+        mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+        NUMA_Bind(first_page, last_page - first_page, memory_mpol_preferred, mask);
+        // Pages are allocated (on that node) when touched, by any thread.
+        return;
+    }
+
+    if (placement == MEMORY_NUMA_INTERLEAVE)
+    {
+        for (int node = 0 ; node < NUMA_Nb_Nodes() ; node++)
+            mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+        NUMA_Bind(first_page, last_page - first_page, memory_mpol_interleave, mask);
+    }
+
+    // Zero (touch) in parallel, each thread the chunk of elements it gets
+    // from "#pragma omp for schedule(static)".
+    const size_t nb_elements = bytes / element_size;
+    #pragma omp parallel
+    {
+#ifdef _OPENMP
+        const size_t nb_threads = size_t(omp_get_num_threads());
+        const size_t thread     = size_t(omp_get_thread_num());
+#else // #ifdef _OPENMP
+        const size_t nb_threads = 1;
+        const size_t thread     = 0;
+#endif // #ifdef _OPENMP
+        const size_t chunk = (nb_elements + nb_threads - 1) / nb_threads;
+        const size_t first = (thread * chunk < nb_elements ? thread * chunk : nb_elements);
+        const size_t last  = (first + chunk < nb_elements ? first + chunk : nb_elements);
+        Touch_Pages(begin + first * element_size, begin + last * element_size);
+    }
+}
+
+// **************************************************************
+int Memory_Allocation::Get_NUMA_Nb_Nodes()
+{
+    return NUMA_Nb_Nodes();
+}
+
+// **************************************************************
+uint64_t Memory_Allocation::Get_NUMA_Node_Bytes(const int node)
+/**
+ * Bytes of the process (all its memory, tracked or not) resident on
+ * NUMA node "node", as reported by the kernel in /proc/self/numa_maps.
+ */
+{
+    std::ifstream numa_maps("/proc/self/numa_maps");
+    std::ostringstream key_stream;
+    key_stream << "N" << node << "=";
+    const std::string key = key_stream.str();
+
+    uint64_t bytes = 0;
+    std::string line;
+    while (std::getline(numa_maps, line))
+    {
+        uint64_t pages = 0;
+        uint64_t page_kib = 4;
+        std::istringstream fields(line);
+        std::string field;
+        while (fields >> field)
+        {
+            if (field.compare(0, key.size(), key) == 0)
+                pages = strtoul(field.c_str() + key.size(), NULL, 10);
+            else if (field.compare(0, 17, "kernelpagesize_kB") == 0)
+                page_kib = strtoul(field.c_str() + 18, NULL, 10);
+        }
+        bytes += pages * page_kib * 1024;
+    }
+
+    return bytes;
+}
+
+// ********** End of file ***************************************
@@ -0,0 +1,375 @@
+#ifndef INC_POOL_HPP
+#define INC_POOL_HPP
+
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif // #ifdef _OPENMP
+
+#include "Memory.hpp"
+
+// **************************************************************
+class Pool_Base
+/**
+ * Non-template interface of Pool<T>, used by Memory_Allocation::Print()
+ * to report every registered pool.
+ */
+{
+    public:
+    virtual ~Pool_Base() {}
+    virtual std::string Get_Name() = 0;
+    virtual uint64_t    Get_Object_Size() = 0;
+    virtual uint64_t    Get_Nb_Live() = 0;
+    virtual uint64_t    Get_Capacity() = 0;
+};
+
+// **************************************************************
+// Header at the start of every slab of a pool, followed by the objects.
+struct Pool_Slab
+{
+    Pool_Slab *next;
+    size_t     size;    // Total size of the slab, header included
+};
+
+// Space used by the slab's header, rounded to keep the objects aligned.
+const size_t pool_slab_header_size = 64;
+
+// Per-thread cache of free objects, padded to a full cache line.
+struct Pool_Cache
+{
+    void    *free_list;     // Intrusive list: a free object stores the next one
+    int64_t  nb_free;       // Length of free_list
+    int64_t  nb_allocated;  // Objects allocated by this thread
+    int64_t  nb_freed;      // Objects freed by this thread
+    char     padding[MEMORY_CACHE_LINE_SIZE - sizeof(void *) - 3*sizeof(int64_t)];
+};
+
+// **************************************************************
+template <class T>
+class Pool : public Pool_Base
+/**
+ * Pool of fixed size objects. Memory is taken from the tracked allocator
+ * by slabs of "objects_per_slab" objects and freed objects are recycled
+ * through an intrusive free list, so allocating or freeing an object is a
+ * couple of pointer moves.
+ * Like malloc_and_check(), Allocate() returns raw (not constructed) memory,
+ * or NULL if a new slab was needed and refused (see Memory_Over_Limit_Policy).
+ * With OpenMP, every thread has its own cache of free objects; the shared
+ * free list (and the allocation of new slabs) is only touched by batches.
+ * There are omp_get_max_threads() caches (at construction): threads beyond
+ * those (see Memory_Thread_Index()), or all threads if the caches could not
+ * be allocated, use the shared list directly, under its lock.
+ */
+{
+    private:
+    std::string name;
+    Memory_Tag  tag;                // Slabs are accounted for under the pool's name
+    size_t      slot_size;          // Object size, rounded to hold a pointer
+    int         objects_per_slab;
+    int         batch;              // Objects moved at once between a cache and the shared list
+
+    Pool_Slab  *slabs;
+    uint64_t    capacity;           // Total number of objects in all slabs
+    void       *free_list;          // Shared list of free objects
+    int64_t     nb_free;
+    int64_t     nb_allocated_shared;    // Objects allocated and freed without a cache
+    int64_t     nb_freed_shared;
+
+    Pool_Cache *caches;
+    int         nb_caches;
+
+    // Not copyable
+    Pool(const Pool &other);
+    Pool & operator=(const Pool &other);
+
+    // **************************************************************
+    inline Pool_Cache * Current_Cache()
+    /**
+     * Cache of the calling thread, NULL if it has none.
+     */
+    {
+#ifdef _OPENMP
+        const int thread = Memory_Thread_Index();
+#else // #ifdef _OPENMP
+        const int thread = 0;
+#endif // #ifdef _OPENMP
+        return (thread < nb_caches ? caches + thread : NULL);
+    }
+
+    // **************************************************************
+    Pool_Slab * New_Slab()
+    /**
+     * Allocate a slab (outside of the critical section: alloc_and_check()
+     * may throw (MEMORY_POLICY_THROW) or call shrinkers). NULL if refused.
+     */
+    {
+        const size_t size = pool_slab_header_size + size_t(objects_per_slab) * slot_size;
+        Pool_Slab *slab = reinterpret_cast<Pool_Slab *>(alloc_and_check<char>(size, false, name.c_str(), MEMORY_CACHE_LINE_SIZE, tag.id));
+        if (slab != NULL)
+            slab->size = size;
+        return slab;
+    }
+
+    // **************************************************************
+    void Add_Slab(Pool_Slab *slab)
+    /**
+     * Put all the objects of the new slab on the shared free list.
+     * Must be called inside the "memory_pool" critical section.
+     */
+    {
+        slab->next = slabs;
+        slabs      = slab;
+
+        char *objects = reinterpret_cast<char *>(slab) + pool_slab_header_size;
+        for (int i = objects_per_slab-1 ; i >= 0 ; i--)
+        {
+            void *object = objects + size_t(i) * slot_size;
+            *((void **) object) = free_list;
+            free_list = object;
+        }
+        nb_free  += objects_per_slab;
+        capacity += uint64_t(objects_per_slab);
+    }
+
+    // **************************************************************
+    void Move_Batch(Pool_Cache &cache)
+    /**
+     * Move up to a batch of objects from the shared list to the cache.
+     * Must be called inside the "memory_pool" critical section.
+     */
+    {
+        for (int i = 0 ; i < batch && free_list != NULL ; i++)
+        {
+            void *object    = free_list;
+            free_list       = *((void **) object);
+            *((void **) object) = cache.free_list;
+            cache.free_list = object;
+            cache.nb_free++;
+            nb_free--;
+        }
+    }
+
+    // **************************************************************
+    void Refill(Pool_Cache &cache)
+    /**
+     * Move a batch of objects from the shared list to the (empty) cache,
+     * allocating a new slab if the shared list is empty. If it is refused,
+     * the cache stays empty.
+     */
+    {
+        #pragma omp critical (memory_pool)
+        Move_Batch(cache);
+        if (cache.free_list != NULL)
+            return;
+
+        Pool_Slab *slab = New_Slab();
+        if (slab == NULL)
+            return;
+
+        #pragma omp critical (memory_pool)
+        {
+            Add_Slab(slab);
+            Move_Batch(cache);
+        }
+    }
+
+    // **************************************************************
+    void Drain(Pool_Cache &cache)
+    /**
+     * Give back a batch of objects from the (too large) cache to the shared list.
+     */
+    {
+        #pragma omp critical (memory_pool)
+        {
+            for (int i = 0 ; i < batch ; i++)
+            {
+                void *object    = cache.free_list;
+                cache.free_list = *((void **) object);
+                cache.nb_free--;
+                *((void **) object) = free_list;
+                free_list       = object;
+                nb_free++;
+            }
+        }
+    }
+
+    // **************************************************************
+    void * Pop_Shared()
+    /**
+     * One object from the shared list (NULL if empty), for a thread without
+     * a cache. Must be called inside the "memory_pool" critical section.
+     */
+    {
+        void *object = free_list;
+        if (object != NULL)
+        {
+            free_list = *((void **) object);
+            nb_free--;
+            nb_allocated_shared++;
+        }
+        return object;
+    }
+
+    // **************************************************************
+    void * Allocate_Shared()
+    {
+        void *object;
+        #pragma omp critical (memory_pool)
+        object = Pop_Shared();
+        if (object != NULL)
+            return object;
+
+        Pool_Slab *slab = New_Slab();
+        if (slab == NULL)
+            return NULL;
+
+        #pragma omp critical (memory_pool)
+        {
+            Add_Slab(slab);
+            object = Pop_Shared();
+        }
+        return object;
+    }
+
+    // **************************************************************
+    void Free_Shared(void *object)
+    {
+        #pragma omp critical (memory_pool)
+        {
+            *((void **) object) = free_list;
+            free_list = object;
+            nb_free++;
+            nb_freed_shared++;
+        }
+    }
+
+    public:
+    // **************************************************************
+    Pool(const std::string _name = "Pool", const int _objects_per_slab = 1024)
+    {
+        name             = _name;
+        tag              = allocated_memory.Register_Tag(name);
+        objects_per_slab = _objects_per_slab;
+        batch            = 32;
+        slabs            = NULL;
+        capacity         = 0;
+        free_list        = NULL;
+        nb_free          = 0;
+        nb_allocated_shared = 0;
+        nb_freed_shared     = 0;
+
+        // Round the object size to a multiple of a pointer size (which keeps T's alignment).
+        slot_size = (sizeof(T) + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+
+#ifdef _OPENMP
+        nb_caches = omp_get_max_threads();
+#else // #ifdef _OPENMP
+        nb_caches = 1;
+#endif // #ifdef _OPENMP
+        caches = calloc_and_check_aligned<Pool_Cache>(nb_caches, tag, MEMORY_CACHE_LINE_SIZE);
+        // Refused (MEMORY_POLICY_RETURN_NULL): no caches, the pool still works.
+        if (caches == NULL)
+            nb_caches = 0;
+
+        allocated_memory.Register_Pool(this);
+    }
+
+    // **************************************************************
+    ~Pool()
+    /**
+     * Give back all slabs. Objects still allocated become invalid.
+     */
+    {
+        allocated_memory.Unregister_Pool(this);
+
+        while (slabs != NULL)
+        {
+            Pool_Slab *next = slabs->next;
+            char *p = reinterpret_cast<char *>(slabs);
+            free_me(p, slabs->size, tag);
+            slabs = next;
+        }
+        free_me(caches, nb_caches, tag);
+    }
+
+    // **************************************************************
+    inline T * Allocate()
+    {
+        Pool_Cache *current = Current_Cache();
+        if (MEMORY_UNLIKELY(current == NULL))
+            return static_cast<T *>(Allocate_Shared());
+
+        Pool_Cache &cache = *current;
+        if (MEMORY_UNLIKELY(cache.free_list == NULL))
+        {
+            Refill(cache);
+            // New slab refused (MEMORY_POLICY_RETURN_NULL)
+            if (cache.free_list == NULL)
+                return NULL;
+        }
+
+        void *object    = cache.free_list;
+        cache.free_list = *((void **) object);
+        cache.nb_free--;
+        cache.nb_allocated++;
+
+        return static_cast<T *>(object);
+    }
+
+    // **************************************************************
+    inline void Free(T *p)
+    {
+        if (p == NULL)
+            return;
+
+        Pool_Cache *current = Current_Cache();
+        if (MEMORY_UNLIKELY(current == NULL))
+        {
+            Free_Shared(p);
+            return;
+        }
+
+        Pool_Cache &cache = *current;
+        *((void **) p)  = cache.free_list;
+        cache.free_list = p;
+        cache.nb_free++;
+        cache.nb_freed++;
+
+        if (cache.nb_free > 2*batch)
+            Drain(cache);
+    }
+
+    // **************************************************************
+    std::string Get_Name()          { return name;      }
+    uint64_t    Get_Object_Size()   { return slot_size; }
+    uint64_t    Get_Capacity()      { return capacity;  }
+
+    // **************************************************************
+    uint64_t Get_Nb_Live()
+    /**
+     * Number of objects currently allocated (summed over all threads' caches).
+     */
+    {
+        int64_t nb_live = nb_allocated_shared - nb_freed_shared;
+        for (int i = 0 ; i < nb_caches ; i++)
+            nb_live += caches[i].nb_allocated - caches[i].nb_freed;
+        return uint64_t(nb_live);
+    }
+
+    // **************************************************************
+    void Print()
+    {
+        std_cout.Clear_Format();
+        std_cout
+            << "Pool information:\n"
+            << "    Name:               " << name << "\n"
+            << "    Object size:        " << slot_size << " bytes\n"
+            << "    Live objects:       " << Get_Nb_Live() << "\n"
+            << "    Capacity:           " << Get_Capacity() << "\n";
+    }
+};
+
+#endif // INC_POOL_HPP
+
+// ********** End of file ***************************************
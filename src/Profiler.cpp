@@ -0,0 +1,515 @@
+// **************************************************************
+//              Sampling allocation profiler
+// **************************************************************
+
+#include <cmath>    // log(), exp()
+#include <cstdio>   // FILE
+#include <cstdlib>  // rand_r(), atexit()
+#include <cstring>  // memset()
+#include <fstream>
+#include <sstream>
+#include <execinfo.h>   // backtrace(), backtrace_symbols()
+#if defined(__GNUC__)
+#include <cxxabi.h>     // abi::__cxa_demangle()
+#endif // #if defined(__GNUC__)
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif // #ifdef _OPENMP
+
+#include "Profiler.hpp"
+
+bool memory_profiling = false;
+Memory_Profiler memory_profiler;
+
+// Marks a slot of the block table whose block was freed.
+static void * const memory_profile_tombstone = reinterpret_cast<void *>(1);
+
+// **************************************************************
+void Memory_Profile_Allocation(void *p, const uint64_t bytes)
+/**
+ * Called by alloc_and_check() while profiling. The call stack is captured
+ * here so that frame 0 is this function and frame 1 the caller of
+ * alloc_and_check() (which is inlined).
+ */
+{
+    if (p == NULL || !memory_profiler.Should_Sample(bytes))
+        return;
+
+    void *frames[memory_profile_max_depth + 1];
+    const int depth = backtrace(frames, memory_profile_max_depth + 1);
+    memory_profiler.Record_Sample(p, bytes, frames + 1, depth - 1);
+}
+
+// **************************************************************
+void Memory_Profile_Free(void *p)
+{
+    memory_profiler.Sample_Free(p);
+}
+
+// **************************************************************
+static void Memory_Profiler_At_Exit()
+{
+    memory_profiler.Dump_At_Exit();
+}
+
+// **************************************************************
+static inline int Thread_Number()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else // #ifdef _OPENMP
+    return 0;
+#endif // #ifdef _OPENMP
+}
+
+// **************************************************************
+static inline size_t Block_Slot(const void *p)
+{
+    const uint64_t golden = (uint64_t(0x9E3779B9u) << 32) | uint64_t(0x7F4A7C15u);
+    const uint64_t h      = (uint64_t(uintptr_t(p)) >> 4) * golden;
+    return size_t(h >> 32) & (MEMORY_PROFILE_TABLE_SIZE - 1);
+}
+
+// **************************************************************
+static inline void * Read_Pointer(void * const *address)
+{
+    return *(void * const volatile *) address;
+}
+
+// **************************************************************
+Memory_Profiler::Memory_Profiler()
+{
+    sample_interval = 524288;
+    blocks          = NULL;
+    samplers        = NULL;
+    nb_samplers     = 0;
+}
+
+// **************************************************************
+Memory_Profiler::~Memory_Profiler()
+{
+    memory_profiling = false;
+    free(blocks);
+    free(samplers);
+}
+
+// **************************************************************
+void Memory_Profiler::Enable(const uint64_t _sample_interval, const std::string &_dump_at_exit)
+/**
+ * Start sampling one allocation every "_sample_interval" bytes (on average).
+ * If "_dump_at_exit" is given, the pprof profile is written to that file at
+ * exit (and the live flamegraph to "_dump_at_exit.folded").
+ * The profiler's own data is not tracked by allocated_memory.
+ */
+{
+    static bool at_exit_registered = false;
+
+    memory_profiling = false;
+
+    #pragma omp critical (memory_profiler)
+    {
+        sample_interval = (_sample_interval == 0 ? 1 : _sample_interval);
+        dump_at_exit    = _dump_at_exit;
+
+        if (blocks == NULL)
+            blocks = static_cast<Memory_Profile_Block *>(calloc(MEMORY_PROFILE_TABLE_SIZE, sizeof(Memory_Profile_Block)));
+
+        if (samplers == NULL)
+        {
+#ifdef _OPENMP
+            nb_samplers = omp_get_max_threads();
+#else // #ifdef _OPENMP
+            nb_samplers = 1;
+#endif // #ifdef _OPENMP
+            void *p = NULL;
+            if (posix_memalign(&p, MEMORY_CACHE_LINE_SIZE, nb_samplers * sizeof(Memory_Profile_Sampler)) != 0)
+                p = NULL;
+            samplers = static_cast<Memory_Profile_Sampler *>(p);
+        }
+
+        if (blocks == NULL || samplers == NULL)
+        {
+            std_cout << "ERROR: Can't allocate memory for the allocation profiler.\n";
+            abort();
+        }
+
+        for (int i = 0 ; i < nb_samplers ; i++)
+        {
+            samplers[i].seed               = 12345u + 7919u * (unsigned int) i;
+            samplers[i].bytes_until_sample = Next_Sample_Distance(samplers[i]);
+        }
+
+        if (!dump_at_exit.empty() && !at_exit_registered)
+        {
+            atexit(Memory_Profiler_At_Exit);
+            at_exit_registered = true;
+        }
+    }
+
+    // The first call to backtrace() may load libraries: do it now.
+    void *frames[2];
+    backtrace(frames, 2);
+
+    memory_profiling = true;
+}
+
+// **************************************************************
+void Memory_Profiler::Disable()
+/**
+ * Stop sampling and following sampled blocks. The profile is kept.
+ */
+{
+    memory_profiling = false;
+}
+
+// **************************************************************
+void Memory_Profiler::Reset()
+/**
+ * Forget all samples.
+ */
+{
+    #pragma omp critical (memory_profiler)
+    {
+        sites.clear();
+        site_ids.clear();
+        if (blocks != NULL)
+            memset(blocks, 0, MEMORY_PROFILE_TABLE_SIZE * sizeof(Memory_Profile_Block));
+    }
+}
+
+// **************************************************************
+int64_t Memory_Profiler::Next_Sample_Distance(Memory_Profile_Sampler &sampler)
+/**
+ * Exponentially distributed distance (in bytes) to the next sample, of mean
+ * "sample_interval": every byte has the same probability of being sampled.
+ */
+{
+    const double u = (double(rand_r(&sampler.seed)) + 1.0) / (double(RAND_MAX) + 1.0);
+    return int64_t(-log(u) * double(sample_interval)) + 1;
+}
+
+// **************************************************************
+bool Memory_Profiler::Should_Sample(const uint64_t bytes)
+{
+    Memory_Profile_Sampler &sampler = samplers[Thread_Number() % nb_samplers];
+
+    sampler.bytes_until_sample -= int64_t(bytes);
+    if (sampler.bytes_until_sample > 0)
+        return false;
+
+    sampler.bytes_until_sample = Next_Sample_Distance(sampler);
+    return true;
+}
+
+// **************************************************************
+int Memory_Profiler::Find_Site(void * const *frames, const int depth)
+/**
+ * Index of the site with this call stack, created if needed.
+ * Must be called inside the "memory_profiler" critical section.
+ */
+{
+    const std::vector<void *> key(frames, frames + depth);
+    std::map<std::vector<void *>, int>::iterator it = site_ids.find(key);
+    if (it != site_ids.end())
+        return it->second;
+
+    Memory_Profile_Site site;
+    memset(&site, 0, sizeof(site));
+    for (int i = 0 ; i < depth ; i++)
+        site.frames[i] = frames[i];
+    site.depth = depth;
+
+    sites.push_back(site);
+    site_ids[key] = int(sites.size()) - 1;
+
+    return int(sites.size()) - 1;
+}
+
+// **************************************************************
+void Memory_Profiler::Record_Sample(void *p, const uint64_t bytes, void * const *frames, const int depth)
+/**
+ * Add a sampled allocation of "bytes" bytes at "p" to its call site's
+ * profile. The sample stands for 1/(1-exp(-bytes/sample_interval))
+ * allocations of that size.
+ */
+{
+    const double probability = 1.0 - exp(-double(bytes) / double(sample_interval));
+    const double count       = (probability > 0.0 ? 1.0 / probability : 0.0);
+    const double weight      = count * double(bytes);
+
+    #pragma omp critical (memory_profiler)
+    {
+        const int s = Find_Site(frames, (depth > 0 ? depth : 0));
+        sites[s].total_count += count;
+        sites[s].total_bytes += weight;
+
+        // Follow the block until it is freed (if there is room in the table).
+        // A block freed while profiling was disabled keeps its slot: if
+        // malloc() gave its address back, that stale entry is replaced.
+        int    free_slot = -1;
+        size_t slot      = Block_Slot(p);
+        for (int probe = 0 ; probe < MEMORY_PROFILE_TABLE_SIZE ; probe++)
+        {
+            void *current = blocks[slot].pointer;
+            if (current == p)
+            {
+                const int stale = blocks[slot].site;
+                sites[stale].live_count -= blocks[slot].count;
+                sites[stale].live_bytes -= blocks[slot].bytes;
+                blocks[slot].pointer = memory_profile_tombstone;
+                free_slot = int(slot);
+                break;
+            }
+            if (current == memory_profile_tombstone && free_slot < 0)
+                free_slot = int(slot);
+            if (current == NULL)
+            {
+                if (free_slot < 0)
+                    free_slot = int(slot);
+                break;
+            }
+            slot = (slot + 1) & (MEMORY_PROFILE_TABLE_SIZE - 1);
+        }
+
+        if (free_slot >= 0)
+        {
+            blocks[free_slot].site   = s;
+            blocks[free_slot].count  = count;
+            blocks[free_slot].bytes  = weight;
+#if defined(__GNUC__)
+            __sync_synchronize();   // Fill the slot before publishing it
+#endif // #if defined(__GNUC__)
+            blocks[free_slot].pointer = p;
+
+            sites[s].live_count += count;
+            sites[s].live_bytes += weight;
+        }
+    }
+}
+
+// **************************************************************
+void Memory_Profiler::Sample_Free(void *p)
+/**
+ * Called by free_me() while profiling. Only sampled blocks take the lock:
+ * others are rejected by a lock-free probe of the block table.
+ */
+{
+    if (blocks == NULL)
+        return;
+
+    size_t slot = Block_Slot(p);
+    for (int probe = 0 ; probe < MEMORY_PROFILE_TABLE_SIZE ; probe++)
+    {
+        void *current = Read_Pointer(&blocks[slot].pointer);
+        if (current == NULL)
+            return;
+        if (current == p)
+            break;
+        slot = (slot + 1) & (MEMORY_PROFILE_TABLE_SIZE - 1);
+    }
+
+    #pragma omp critical (memory_profiler)
+    {
+        if (blocks[slot].pointer == p)
+        {
+            const int s = blocks[slot].site;
+            sites[s].live_count -= blocks[slot].count;
+            sites[s].live_bytes -= blocks[slot].bytes;
+
+            // Mark the slot as free. Tombstones directly followed by an empty
+            // slot end the probe sequences going through them: empty them too.
+            const size_t next = (slot + 1) & (MEMORY_PROFILE_TABLE_SIZE - 1);
+            if (blocks[next].pointer == NULL)
+            {
+                size_t i = slot;
+                do
+                {
+                    blocks[i].pointer = NULL;
+                    i = (i - 1) & (MEMORY_PROFILE_TABLE_SIZE - 1);
+                } while (blocks[i].pointer == memory_profile_tombstone);
+            }
+            else
+            {
+                blocks[slot].pointer = memory_profile_tombstone;
+            }
+        }
+    }
+}
+
+// **************************************************************
+size_t Memory_Profiler::Get_Nb_Sites()
+{
+    return sites.size();
+}
+
+// **************************************************************
+double Memory_Profiler::Get_Live_Bytes()
+/**
+ * Estimated bytes in use, allocated by all sampled call sites.
+ */
+{
+    double total = 0.0;
+    #pragma omp critical (memory_profiler)
+    {
+        for (size_t s = 0 ; s < sites.size() ; s++)
+            total += sites[s].live_bytes;
+    }
+    return total;
+}
+
+// **************************************************************
+double Memory_Profiler::Get_Total_Bytes()
+/**
+ * Estimated bytes allocated since profiling started (or Reset()).
+ */
+{
+    double total = 0.0;
+    #pragma omp critical (memory_profiler)
+    {
+        for (size_t s = 0 ; s < sites.size() ; s++)
+            total += sites[s].total_bytes;
+    }
+    return total;
+}
+
+// **************************************************************
+bool Memory_Profiler::Dump_Pprof(const std::string &filename)
+/**
+ * Write the profile in the (legacy) heap profile text format read by pprof:
+ *     pprof --text ./program profile.heap
+ * Values are already scaled to estimates of the real counts and bytes.
+ */
+{
+    std::ofstream out(filename.c_str());
+    if (!out)
+    {
+        std_cout << "ERROR: Can't open \"" << filename << "\" to write the allocation profile.\n";
+        return false;
+    }
+
+    #pragma omp critical (memory_profiler)
+    {
+        double live_count = 0.0, live_bytes = 0.0, total_count = 0.0, total_bytes = 0.0;
+        for (size_t s = 0 ; s < sites.size() ; s++)
+        {
+            live_count  += sites[s].live_count;
+            live_bytes  += sites[s].live_bytes;
+            total_count += sites[s].total_count;
+            total_bytes += sites[s].total_bytes;
+        }
+
+        out << "heap profile: " << uint64_t(live_count + 0.5) << ": " << uint64_t(live_bytes + 0.5)
+            << " [" << uint64_t(total_count + 0.5) << ": " << uint64_t(total_bytes + 0.5) << "] @ heap\n";
+
+        for (size_t s = 0 ; s < sites.size() ; s++)
+        {
+            out << uint64_t(sites[s].live_count + 0.5) << ": " << uint64_t(sites[s].live_bytes + 0.5)
+                << " [" << uint64_t(sites[s].total_count + 0.5) << ": " << uint64_t(sites[s].total_bytes + 0.5) << "] @";
+            for (int f = 0 ; f < sites[s].depth ; f++)
+                out << " " << sites[s].frames[f];
+            out << "\n";
+        }
+    }
+
+    // pprof needs the memory map to symbolize the addresses.
+    out << "\nMAPPED_LIBRARIES:\n";
+    std::ifstream maps("/proc/self/maps");
+    out << maps.rdbuf();
+
+    return true;
+}
+
+// **************************************************************
+std::string Memory_Profiler::Symbolize(void *frame)
+/**
+ * Function name of a return address (link with -rdynamic to get the names
+ * of the program's own functions), or the address itself.
+ */
+{
+    std::ostringstream name;
+    name << frame;
+
+    char **symbols = backtrace_symbols(&frame, 1);
+    if (symbols == NULL)
+        return name.str();
+
+    // Format: "binary(mangled+0x12) [0x...]"
+    std::string symbol(symbols[0]);
+    free(symbols);
+
+    const size_t begin = symbol.find('(');
+    const size_t end   = symbol.find('+', begin);
+    if (begin == std::string::npos || end == std::string::npos || end == begin + 1)
+        return name.str();
+
+    const std::string mangled = symbol.substr(begin + 1, end - begin - 1);
+#if defined(__GNUC__)
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(mangled.c_str(), NULL, NULL, &status);
+    if (demangled != NULL)
+    {
+        const std::string result(demangled);
+        free(demangled);
+        return result;
+    }
+#endif // #if defined(__GNUC__)
+    return mangled;
+}
+
+// **************************************************************
+bool Memory_Profiler::Dump_Flamegraph(const std::string &filename, const bool live)
+/**
+ * Write the live (or cumulative) bytes per call stack as "folded stacks"
+ * (one "outer;...;inner bytes" line per site), the input of flamegraph.pl:
+ *     flamegraph.pl --countname=bytes profile.folded > profile.svg
+ */
+{
+    std::ofstream out(filename.c_str());
+    if (!out)
+    {
+        std_cout << "ERROR: Can't open \"" << filename << "\" to write the allocation profile.\n";
+        return false;
+    }
+
+    // Copy the sites: symbolizing is slow and must not hold the lock.
+    std::vector<Memory_Profile_Site> copy;
+    #pragma omp critical (memory_profiler)
+    {
+        copy = sites;
+    }
+
+    std::map<void *, std::string> names;
+    for (size_t s = 0 ; s < copy.size() ; s++)
+    {
+        const uint64_t bytes = uint64_t((live ? copy[s].live_bytes : copy[s].total_bytes) + 0.5);
+        if (bytes == 0)
+            continue;
+
+        // Outermost frame first
+        for (int f = copy[s].depth - 1 ; f >= 0 ; f--)
+        {
+            void *frame = copy[s].frames[f];
+            std::map<void *, std::string>::iterator it = names.find(frame);
+            if (it == names.end())
+                it = names.insert(std::make_pair(frame, Symbolize(frame))).first;
+            out << it->second << (f > 0 ? ";" : "");
+        }
+        out << " " << bytes << "\n";
+    }
+
+    return true;
+}
+
+// **************************************************************
+void Memory_Profiler::Dump_At_Exit()
+{
+    if (dump_at_exit.empty())
+        return;
+
+    memory_profiling = false;
+    Dump_Pprof(dump_at_exit);
+    Dump_Flamegraph(dump_at_exit + ".folded");
+}
+
+// ********** End of file ***************************************
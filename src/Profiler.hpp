@@ -0,0 +1,104 @@
+#ifndef INC_PROFILER_HPP
+#define INC_PROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "Memory.hpp"
+
+// Deepest call stack recorded for a sampled allocation.
+const int memory_profile_max_depth = 32;
+
+// Number of sampled blocks that can be alive at the same time (power of two).
+#ifndef MEMORY_PROFILE_TABLE_SIZE
+#define MEMORY_PROFILE_TABLE_SIZE 65536
+#endif // #ifndef MEMORY_PROFILE_TABLE_SIZE
+
+// **************************************************************
+// Call site (call stack) of sampled allocations. Counts and bytes are
+// estimates: every sample is weighted by the inverse of its probability.
+struct Memory_Profile_Site
+{
+    void    *frames[memory_profile_max_depth];
+    int      depth;
+    double   live_count;
+    double   live_bytes;
+    double   total_count;
+    double   total_bytes;
+};
+
+// **************************************************************
+// Sampled block still alive: which site it belongs to and its weight.
+struct Memory_Profile_Block
+{
+    void    *pointer;   // NULL: empty slot
+    int      site;
+    double   count;
+    double   bytes;
+};
+
+// **************************************************************
+// Per-thread sampler state, padded to a full cache line.
+struct Memory_Profile_Sampler
+{
+    int64_t      bytes_until_sample;
+    unsigned int seed;
+    char         padding[MEMORY_CACHE_LINE_SIZE - sizeof(int64_t) - sizeof(unsigned int)];
+};
+
+// **************************************************************
+class Memory_Profiler
+/**
+ * Sampling allocation profiler (opt-in, see Enable()). On average one
+ * allocation every "sample_interval" bytes is sampled (exponentially
+ * distributed intervals, like tcmalloc), its call stack is recorded and it is
+ * followed until free_me(). Live (in use) and cumulative profiles are kept
+ * per call site and can be written in pprof's heap profile format or as
+ * folded stacks for flamegraph.pl. Unsampled allocations only pay for a
+ * per-thread counter decrement.
+ */
+{
+    private:
+        uint64_t                            sample_interval;
+        std::vector<Memory_Profile_Site>    sites;
+        std::map<std::vector<void *>, int>  site_ids;
+        Memory_Profile_Block               *blocks;
+        Memory_Profile_Sampler             *samplers;
+        int                                 nb_samplers;
+        std::string                         dump_at_exit;
+
+        int         Find_Site(void * const *frames, const int depth);
+        int64_t     Next_Sample_Distance(Memory_Profile_Sampler &sampler);
+        std::string Symbolize(void *frame);
+
+        // Not copyable
+        Memory_Profiler(const Memory_Profiler &other);
+        Memory_Profiler & operator=(const Memory_Profiler &other);
+
+    public:
+        Memory_Profiler();
+        ~Memory_Profiler();
+
+        void        Enable(const uint64_t _sample_interval = 524288, const std::string &_dump_at_exit = "");
+        void        Disable();
+        void        Reset();
+
+        bool        Should_Sample(const uint64_t bytes);
+        void        Record_Sample(void *p, const uint64_t bytes, void * const *frames, const int depth);
+        void        Sample_Free(void *p);
+
+        size_t      Get_Nb_Sites();
+        double      Get_Live_Bytes();
+        double      Get_Total_Bytes();
+
+        bool        Dump_Pprof(const std::string &filename);
+        bool        Dump_Flamegraph(const std::string &filename, const bool live = true);
+        void        Dump_At_Exit();
+};
+
+extern Memory_Profiler memory_profiler;
+
+#endif // INC_PROFILER_HPP
+
+// ********** End of file ***************************************
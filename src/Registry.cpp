@@ -0,0 +1,227 @@
+// **************************************************************
+//              Registry of the live tracked blocks
+// **************************************************************
+
+#include <cstdlib>  // calloc(), free()
+#include <time.h>   // clock_gettime()
+
+#include "Registry.hpp"
+
+// **************************************************************
+static inline uint64_t Pointer_Hash(const void *p)
+{
+    const uint64_t golden = (uint64_t(0x9E3779B9u) << 32) | uint64_t(0x7F4A7C15u);
+    return (uint64_t(uintptr_t(p)) >> 4) * golden;
+}
+
+// **************************************************************
+static double Monotonic_Clock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return double(now.tv_sec) + 1.0e-9 * double(now.tv_nsec);
+}
+
+// **************************************************************
+Memory_Live_Registry::Memory_Live_Registry()
+{
+    void *p = NULL;
+    if (posix_memalign(&p, MEMORY_CACHE_LINE_SIZE, MEMORY_REGISTRY_NB_SHARDS * sizeof(Memory_Registry_Shard)) != 0)
+    {
+        std_cout << "ERROR: Can't allocate memory for the live blocks registry.\n";
+        abort();
+    }
+    shards = static_cast<Memory_Registry_Shard *>(p);
+
+    for (int i = 0 ; i < MEMORY_REGISTRY_NB_SHARDS ; i++)
+    {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].capacity  = 64;
+        shards[i].slots     = static_cast<Memory_Live_Block *>(calloc(shards[i].capacity, sizeof(Memory_Live_Block)));
+        shards[i].nb_blocks = 0;
+        shards[i].bytes     = 0;
+        if (shards[i].slots == NULL)
+        {
+            std_cout << "ERROR: Can't allocate memory for the live blocks registry.\n";
+            abort();
+        }
+    }
+
+    start_time = Monotonic_Clock();
+}
+
+// **************************************************************
+Memory_Live_Registry::~Memory_Live_Registry()
+{
+    for (int i = 0 ; i < MEMORY_REGISTRY_NB_SHARDS ; i++)
+    {
+        pthread_mutex_destroy(&shards[i].lock);
+        free(shards[i].slots);
+    }
+    free(shards);
+}
+
+// **************************************************************
+Memory_Registry_Shard & Memory_Live_Registry::Shard_Of(const void *p, uint64_t &hash)
+/**
+ * The upper bits of the hash select the shard, the lower ones the slot.
+ */
+{
+    hash = Pointer_Hash(p);
+    return shards[(hash >> 48) & (MEMORY_REGISTRY_NB_SHARDS - 1)];
+}
+
+// **************************************************************
+void Memory_Live_Registry::Insert(Memory_Live_Block *slots, const uint64_t capacity, const uint64_t hash, const Memory_Live_Block &block)
+{
+    uint64_t slot = hash & (capacity - 1);
+    while (slots[slot].pointer != NULL)
+        slot = (slot + 1) & (capacity - 1);
+    slots[slot] = block;
+}
+
+// **************************************************************
+void Memory_Live_Registry::Grow(Memory_Registry_Shard &shard)
+/**
+ * Double the shard's table. Called with the shard locked.
+ */
+{
+    const uint64_t new_capacity = 2 * shard.capacity;
+    Memory_Live_Block *new_slots = static_cast<Memory_Live_Block *>(calloc(new_capacity, sizeof(Memory_Live_Block)));
+    if (new_slots == NULL)
+    {
+        std_cout << "ERROR: Can't grow the live blocks registry.\n";
+        abort();
+    }
+
+    for (uint64_t i = 0 ; i < shard.capacity ; i++)
+    {
+        if (shard.slots[i].pointer != NULL)
+            Insert(new_slots, new_capacity, Pointer_Hash(shard.slots[i].pointer), shard.slots[i]);
+    }
+
+    free(shard.slots);
+    shard.slots    = new_slots;
+    shard.capacity = new_capacity;
+}
+
+// **************************************************************
+void Memory_Live_Registry::Add(void *p, const uint64_t bytes, const int tag)
+{
+    uint64_t hash;
+    Memory_Registry_Shard &shard = Shard_Of(p, hash);
+
+    Memory_Live_Block block;
+    block.pointer   = p;
+    block.bytes     = bytes;
+    block.tag       = tag;
+    block.time      = Monotonic_Clock() - start_time;
+
+    pthread_mutex_lock(&shard.lock);
+    // Keep the load factor under 1/2.
+    if (2 * (shard.nb_blocks + 1) > shard.capacity)
+        Grow(shard);
+    Insert(shard.slots, shard.capacity, hash, block);
+    shard.nb_blocks++;
+    shard.bytes += bytes;
+    pthread_mutex_unlock(&shard.lock);
+}
+
+// **************************************************************
+bool Memory_Live_Registry::Remove(void *p)
+/**
+ * Returns false if "p" was not registered (allocated before the registry
+ * was enabled, for example).
+ */
+{
+    uint64_t hash;
+    Memory_Registry_Shard &shard = Shard_Of(p, hash);
+    bool found = false;
+
+    pthread_mutex_lock(&shard.lock);
+    const uint64_t mask = shard.capacity - 1;
+    uint64_t slot = hash & mask;
+    while (shard.slots[slot].pointer != NULL)
+    {
+        if (shard.slots[slot].pointer == p)
+        {
+            found = true;
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (found)
+    {
+        shard.nb_blocks--;
+        shard.bytes -= shard.slots[slot].bytes;
+
+        // Backward shift deletion: move up the following blocks that
+        // would not be found anymore through the emptied slot.
+        uint64_t hole = slot;
+        uint64_t next = (hole + 1) & mask;
+        while (shard.slots[next].pointer != NULL)
+        {
+            const uint64_t home = Pointer_Hash(shard.slots[next].pointer) & mask;
+            // Can the block at "next" move to "hole"? Only if its home is not
+            // in the (cyclic) range ]hole, next].
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                shard.slots[hole] = shard.slots[next];
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        shard.slots[hole].pointer = NULL;
+    }
+    pthread_mutex_unlock(&shard.lock);
+
+    return found;
+}
+
+// **************************************************************
+uint64_t Memory_Live_Registry::Get_Nb_Blocks()
+{
+    uint64_t total = 0;
+    for (int i = 0 ; i < MEMORY_REGISTRY_NB_SHARDS ; i++)
+    {
+        pthread_mutex_lock(&shards[i].lock);
+        total += shards[i].nb_blocks;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    return total;
+}
+
+// **************************************************************
+uint64_t Memory_Live_Registry::Get_Bytes()
+{
+    uint64_t total = 0;
+    for (int i = 0 ; i < MEMORY_REGISTRY_NB_SHARDS ; i++)
+    {
+        pthread_mutex_lock(&shards[i].lock);
+        total += shards[i].bytes;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    return total;
+}
+
+// **************************************************************
+void Memory_Live_Registry::Get_Blocks(std::vector<Memory_Live_Block> &blocks)
+/**
+ * Copy of all the live blocks.
+ */
+{
+    blocks.clear();
+    for (int i = 0 ; i < MEMORY_REGISTRY_NB_SHARDS ; i++)
+    {
+        pthread_mutex_lock(&shards[i].lock);
+        for (uint64_t s = 0 ; s < shards[i].capacity ; s++)
+        {
+            if (shards[i].slots[s].pointer != NULL)
+                blocks.push_back(shards[i].slots[s]);
+        }
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+}
+
+// ********** End of file ***************************************
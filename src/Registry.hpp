@@ -0,0 +1,70 @@
+#ifndef INC_REGISTRY_HPP
+#define INC_REGISTRY_HPP
+
+#include <vector>
+#include <pthread.h>
+
+#include "Memory.hpp"
+
+// Number of independently locked parts of the registry (power of two).
+#ifndef MEMORY_REGISTRY_NB_SHARDS
+#define MEMORY_REGISTRY_NB_SHARDS 64
+#endif // #ifndef MEMORY_REGISTRY_NB_SHARDS
+
+// **************************************************************
+// A live tracked block.
+struct Memory_Live_Block
+{
+    void    *pointer;   // NULL: empty slot
+    uint64_t bytes;
+    int      tag;
+    double   time;      // Seconds since the registry was enabled
+};
+
+// **************************************************************
+// Open addressing hash table (linear probing) for part of the pointers,
+// protected by its own lock and padded to avoid false sharing.
+struct Memory_Registry_Shard
+{
+    pthread_mutex_t     lock;
+    Memory_Live_Block  *slots;
+    uint64_t            capacity;   // Power of two
+    uint64_t            nb_blocks;
+    uint64_t            bytes;
+    char                padding[MEMORY_CACHE_LINE_SIZE];
+};
+
+// **************************************************************
+class Memory_Live_Registry
+/**
+ * Registry of the live tracked blocks: pointer -> (size, tag, time). Sharded
+ * by pointer hash so that threads rarely wait for each other; each shard is
+ * a small hash table that grows as needed. Its own memory is not tracked.
+ */
+{
+    private:
+        Memory_Registry_Shard  *shards;
+        double                  start_time;
+
+        Memory_Registry_Shard & Shard_Of(const void *p, uint64_t &hash);
+        void    Grow(Memory_Registry_Shard &shard);
+        static void Insert(Memory_Live_Block *slots, const uint64_t capacity, const uint64_t hash, const Memory_Live_Block &block);
+
+        // Not copyable
+        Memory_Live_Registry(const Memory_Live_Registry &other);
+        Memory_Live_Registry & operator=(const Memory_Live_Registry &other);
+
+    public:
+        Memory_Live_Registry();
+        ~Memory_Live_Registry();
+
+        void        Add(void *p, const uint64_t bytes, const int tag);
+        bool        Remove(void *p);
+        uint64_t    Get_Nb_Blocks();
+        uint64_t    Get_Bytes();
+        void        Get_Blocks(std::vector<Memory_Live_Block> &blocks);
+};
+
+#endif // INC_REGISTRY_HPP
+
+// ********** End of file ***************************************
@@ -0,0 +1,223 @@
+#ifndef INC_SEGMENTED_LUT_HPP
+#define INC_SEGMENTED_LUT_HPP
+
+#include <cstring>  // memcpy()
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "LookUpTable.hpp"
+
+// **************************************************************
+inline int LUT_Exponent(const double x)
+/**
+ * Binary exponent of a (positive, normal) floating point number, read from
+ * its exponent field (see Float_in_String_Binary()): x is in [2^e, 2^(e+1)[.
+ */
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return int((bits >> 52) & 0x7ff) - 1023;
+}
+
+// **************************************************************
+inline int LUT_Exponent(const float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return int((bits >> 23) & 0xff) - 127;
+}
+
+// **************************************************************
+template <class Double, int Order = 1>
+class Segmented_LookUpTable
+/**
+ * Table of a function on [xmin, xmax[ (0 < xmin) made of one uniform
+ * LookUpTable per binary octave [2^e, 2^(e+1)[ of x: the segment is found
+ * from the exponent bits of x (no search, no branch) and each segment has
+ * its own dx. Functions steep near zero (1/r) get fine points where needed
+ * without the whole range paying for them.
+ */
+{
+    private:
+    std::string name;
+    Double range_min;
+    Double range_max;
+    int exponent_min;   // Binary exponent of range_min: segment of x is LUT_Exponent(x) - exponent_min
+    int nb_segments;
+    LookUpTable<Double, Order> *segments;
+
+    // Not copyable
+    Segmented_LookUpTable(const Segmented_LookUpTable &other);
+    Segmented_LookUpTable & operator=(const Segmented_LookUpTable &other);
+
+    // **************************************************************
+    void Setup_Segments(const Double _range_min, const Double _range_max, const std::string &_name)
+    {
+        assert(segments == NULL);
+        assert(_range_min >= std::numeric_limits<Double>::min());
+        assert(_range_max > _range_min);
+
+        name         = _name;
+        range_min    = _range_min;
+        range_max    = _range_max;
+        exponent_min = LUT_Exponent(range_min);
+        nb_segments  = LUT_Exponent(range_max) - exponent_min + 1;
+        // range_max is excluded: no segment starting on it.
+        if (Segment_Min(nb_segments-1) >= range_max)
+            nb_segments--;
+        segments     = new LookUpTable<Double, Order>[nb_segments];
+    }
+
+    // **************************************************************
+    Double Segment_Min(const int s) const
+    {
+        const Double octave = Double(std::ldexp(1.0, exponent_min + s));
+        return (octave > range_min ? octave : range_min);
+    }
+
+    // **************************************************************
+    Double Segment_Max(const int s) const
+    {
+        const Double octave = Double(std::ldexp(1.0, exponent_min + s + 1));
+        return (octave < range_max ? octave : range_max);
+    }
+
+    // **************************************************************
+    std::string Segment_Name(const int s) const
+    {
+        std::ostringstream segment_name;
+        segment_name << name << " [" << Segment_Min(s) << ", " << Segment_Max(s) << "[";
+        return segment_name.str();
+    }
+
+    public:
+    // **************************************************************
+    Segmented_LookUpTable()
+    {
+        range_min    = 0.0;
+        range_max    = 0.0;
+        exponent_min = 0;
+        nb_segments  = 0;
+        segments     = NULL;
+    }
+
+    // **************************************************************
+    ~Segmented_LookUpTable()
+    {
+        delete[] segments;
+    }
+
+    // **************************************************************
+    void Initialize(Double (*_function)(Double),
+                    const Double _range_min, const Double _range_max,
+                    const int points_per_segment, const std::string _name,
+                    const LookUpTable_Layout _layout = LUT_LAYOUT_VALUES)
+    /**
+     * Same number of points in every octave: dx is proportional to x
+     * (logarithmic sampling).
+     */
+    {
+        assert(points_per_segment >= 2);
+        Setup_Segments(_range_min, _range_max, _name);
+        for (int s = 0 ; s < nb_segments ; s++)
+            segments[s].Initialize(_function, Segment_Min(s), Segment_Max(s), points_per_segment, Segment_Name(s), NULL, _layout);
+    }
+
+    // **************************************************************
+    bool Initialize_To_Tolerance(Double (*_function)(Double),
+                                 const Double _range_min, const Double _range_max,
+                                 const double max_absolute_error, const double max_relative_error,
+                                 const std::string _name,
+                                 const LookUpTable_Layout _layout = LUT_LAYOUT_VALUES,
+                                 const int max_n_per_segment = lut_tolerance_max_points)
+    /**
+     * Every segment gets the smallest number of points meeting the
+     * tolerance (see LookUpTable::Initialize_To_Tolerance()). Returns false
+     * if a segment does not meet it.
+     */
+    {
+        Setup_Segments(_range_min, _range_max, _name);
+        bool met = true;
+        for (int s = 0 ; s < nb_segments ; s++)
+        {
+            if (!segments[s].Initialize_To_Tolerance(_function, Segment_Min(s), Segment_Max(s),
+                                                     max_absolute_error, max_relative_error,
+                                                     Segment_Name(s), _layout, max_n_per_segment))
+                met = false;
+        }
+        return met;
+    }
+
+    // **************************************************************
+    inline Double read(const Double x)
+    /**
+     *   Interpolated value at x, in [xmin, xmax[.
+     */
+    {
+#ifdef YDEBUG
+        assert(x >= range_min && x < range_max);
+#endif // #ifdef YDEBUG
+        return segments[LUT_Exponent(x) - exponent_min].read(x);
+    }
+
+    // **************************************************************
+    void read_batch(const Double *x, Double *out, const size_t nb)
+    /**
+     *   read() of the "nb" points "x" into "out". Consecutive points in the
+     *   same segment are read with that segment's (vectorized) read_batch().
+     */
+    {
+        size_t first = 0;
+        while (first < nb)
+        {
+            const int segment = LUT_Exponent(x[first]) - exponent_min;
+            size_t last = first + 1;
+            while (last < nb && LUT_Exponent(x[last]) - exponent_min == segment)
+                last++;
+            segments[segment].read_batch(x + first, out + first, last - first);
+            first = last;
+        }
+    }
+
+    // **************************************************************
+    int     Get_Nb_Segments()           { return nb_segments;   }
+    Double  Get_XMin()                  { return range_min;     }
+    Double  Get_XMax()                  { return range_max;     }
+    LookUpTable<Double, Order> & Get_Segment(const int s) { return segments[s]; }
+
+    // **************************************************************
+    int Get_n()
+    /**
+     *   Total number of points, all segments.
+     */
+    {
+        int n = 0;
+        for (int s = 0 ; s < nb_segments ; s++)
+            n += segments[s].Get_n();
+        return n;
+    }
+
+    // **************************************************************
+    void Print()
+    {
+        const int stride = (Order == 3 ? 4 : (nb_segments > 0 && segments[0].Get_Layout() == LUT_LAYOUT_INTERLEAVED ? 2 : 1));
+        std_cout.Clear_Format();
+        std_cout
+            << "Segmented lookup table information:\n"
+            << "    Name:               " << name << "\n"
+            << "    Range:              [" << range_min << ", " << range_max << "]\n"
+            << "    Segments:           " << nb_segments << "\n"
+            << "    Number of points:   " << Get_n() << "\n"
+            << "    Size:               " << Double(stride * Get_n()) * Double(sizeof(Double)) / Double(1024.0) << " kiB\n";
+        for (int s = 0 ; s < nb_segments ; s++)
+        {
+            std_cout << "        [" << Segment_Min(s) << ", " << Segment_Max(s) << "[:  "
+                     << segments[s].Get_n() << " points, dx = " << segments[s].Get_dx() << "\n";
+        }
+    }
+};
+
+#endif // INC_SEGMENTED_LUT_HPP
+
+// ********** End of file ***************************************
@@ -0,0 +1,351 @@
+// **************************************************************
+//              Time-series trace of the memory usage
+// **************************************************************
+
+#include <cstdlib>  // posix_memalign(), free()
+#include <time.h>   // clock_gettime(), nanosleep()
+
+#include "Trace.hpp"
+
+bool memory_tracing = false;
+Memory_Trace memory_trace;
+
+// **************************************************************
+// Atomic helpers for the ring buffer (see the ones in Memory.cpp).
+#if defined(__GNUC__) || defined(__INTEL_COMPILER) || defined(__clang__) || defined(__PATHSCALE__)
+static inline bool Trace_CAS(uint64_t *counter, const uint64_t expected, const uint64_t desired)
+{
+    return __sync_bool_compare_and_swap(counter, expected, desired);
+}
+static inline void Trace_Add(uint64_t *counter, const uint64_t value)
+{
+    __sync_add_and_fetch(counter, value);
+}
+static inline void Trace_Barrier()
+{
+    __sync_synchronize();
+}
+#else // #if defined(__GNUC__) || ...
+static inline bool Trace_CAS(uint64_t *counter, const uint64_t expected, const uint64_t desired)
+{
+    bool swapped = false;
+    #pragma omp critical (memory_trace_counter)
+    {
+        if (*counter == expected)
+        {
+            *counter = desired;
+            swapped  = true;
+        }
+    }
+    return swapped;
+}
+static inline void Trace_Add(uint64_t *counter, const uint64_t value)
+{
+    #pragma omp critical (memory_trace_counter)
+    {
+        *counter += value;
+    }
+}
+static inline void Trace_Barrier()
+{
+    #pragma omp flush
+}
+#endif // #if defined(__GNUC__) || ...
+
+// **************************************************************
+static inline uint64_t Trace_Read(const uint64_t *counter)
+{
+    return *(const volatile uint64_t *) counter;
+}
+
+// **************************************************************
+void Memory_Trace_Event_Hook(const int64_t delta, const int tag)
+{
+    memory_trace.Push(delta, tag);
+}
+
+// **************************************************************
+static double Monotonic_Clock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return double(now.tv_sec) + 1.0e-9 * double(now.tv_nsec);
+}
+
+// **************************************************************
+Memory_Trace::Memory_Trace()
+{
+    file                = NULL;
+    ring                = NULL;
+    ring_size           = 0;
+    enqueue_position    = 0;
+    dequeue_position    = 0;
+    nb_dropped          = 0;
+    nb_written          = 0;
+    flush_interval      = 0.1;
+    start_time          = 0.0;
+    stop_writer         = false;
+    pthread_mutex_init(&phases_lock, NULL);
+}
+
+// **************************************************************
+Memory_Trace::~Memory_Trace()
+{
+    Stop();
+    pthread_mutex_destroy(&phases_lock);
+}
+
+// **************************************************************
+bool Memory_Trace::Start(const std::string &_filename, const double _flush_interval, const uint64_t _ring_size)
+/**
+ * Start tracing to "_filename" (CSV). "_ring_size" (rounded up to a power of
+ * two) is the number of events that can wait for the writer thread.
+ * Must not be called while other threads allocate or free memory.
+ */
+{
+    Stop();
+
+    file = fopen(_filename.c_str(), "w");
+    if (file == NULL)
+    {
+        std_cout << "ERROR: Can't open \"" << _filename << "\" to write the memory trace.\n";
+        return false;
+    }
+    filename        = _filename;
+    flush_interval  = _flush_interval;
+
+    ring_size = 1;
+    while (ring_size < _ring_size)
+        ring_size *= 2;
+
+    // The trace's own buffer is not tracked by allocated_memory.
+    void *p = NULL;
+    if (posix_memalign(&p, MEMORY_CACHE_LINE_SIZE, ring_size * sizeof(Memory_Trace_Event)) != 0)
+    {
+        std_cout << "ERROR: Can't allocate memory for the trace's buffer.\n";
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    ring = static_cast<Memory_Trace_Event *>(p);
+    for (uint64_t i = 0 ; i < ring_size ; i++)
+        ring[i].sequence = i;
+
+    enqueue_position    = 0;
+    dequeue_position    = 0;
+    nb_dropped          = 0;
+    nb_written          = 0;
+    phases.clear();
+    start_time          = Monotonic_Clock();
+    stop_writer         = false;
+
+    fprintf(file, "time,delta,usage,tag,phase\n");
+
+    if (pthread_create(&writer, NULL, Writer_Main, this) != 0)
+    {
+        std_cout << "ERROR: Can't start the trace's writer thread.\n";
+        fclose(file);
+        file = NULL;
+        free(ring);
+        ring = NULL;
+        return false;
+    }
+
+    // Initial usage
+    Push(0, 0);
+
+    memory_tracing = true;
+
+    return true;
+}
+
+// **************************************************************
+void Memory_Trace::Stop()
+/**
+ * Stop tracing: write the pending events and close the file. Like Start(),
+ * it must not be called while other threads allocate or free memory.
+ */
+{
+    if (file == NULL)
+        return;
+
+    memory_tracing = false;
+
+    stop_writer = true;
+    pthread_join(writer, NULL);
+    Write_Pending();
+
+    if (nb_dropped != 0)
+        fprintf(file, "# %lu events dropped (trace buffer full)\n", (unsigned long) nb_dropped);
+    fclose(file);
+    file = NULL;
+
+    free(ring);
+    ring = NULL;
+}
+
+// **************************************************************
+bool Memory_Trace::Is_Running()
+{
+    return file != NULL;
+}
+
+// **************************************************************
+double Memory_Trace::Now()
+{
+    return Monotonic_Clock() - start_time;
+}
+
+// **************************************************************
+void Memory_Trace::Push(const int64_t delta, const int tag, const int phase)
+/**
+ * Add an event to the ring buffer (multiple producers, one consumer). Never
+ * blocks: if the buffer is full, the event is dropped.
+ */
+{
+    Memory_Trace_Event *event;
+    uint64_t position = Trace_Read(&enqueue_position);
+    for (;;)
+    {
+        event = &ring[position & (ring_size - 1)];
+        const int64_t difference = int64_t(Trace_Read(&event->sequence)) - int64_t(position);
+        if (difference == 0)
+        {
+            // Slot free: try to claim it.
+            if (Trace_CAS(&enqueue_position, position, position + 1))
+                break;
+            position = Trace_Read(&enqueue_position);
+        }
+        else if (difference < 0)
+        {
+            // Buffer full
+            Trace_Add(&nb_dropped, 1);
+            return;
+        }
+        else
+        {
+            // Another thread claimed that slot
+            position = Trace_Read(&enqueue_position);
+        }
+    }
+
+    event->time     = Now();
+    event->delta    = delta;
+    event->usage    = allocated_memory.Get_Bytes_Allocated();
+    event->tag      = tag;
+    event->phase    = phase;
+    Trace_Barrier();
+    event->sequence = position + 1;     // Publish
+}
+
+// **************************************************************
+static std::string CSV_Field(const std::string &field)
+/**
+ * "field" as a CSV field: quoted (with doubled quotes inside) if it contains
+ * a comma, a quote or a line break, unchanged otherwise.
+ */
+{
+    if (field.find_first_of(",\"\r\n") == std::string::npos)
+        return field;
+
+    std::string quoted = "\"";
+    for (size_t i = 0 ; i < field.size() ; i++)
+    {
+        if (field[i] == '"')
+            quoted += '"';
+        quoted += field[i];
+    }
+    quoted += '"';
+    return quoted;
+}
+
+// **************************************************************
+void Memory_Trace::Mark(const std::string &phase)
+/**
+ * Add a phase marker (for example the name of the solver step starting now).
+ * Names are quoted in the trace if needed: commas are allowed.
+ */
+{
+    if (file == NULL)
+        return;
+
+    const std::string field = CSV_Field(phase);
+    pthread_mutex_lock(&phases_lock);
+    const int index = int(phases.size());
+    phases.push_back(field);
+    pthread_mutex_unlock(&phases_lock);
+    Push(0, 0, index);
+}
+
+// **************************************************************
+bool Memory_Trace::Write_Pending()
+/**
+ * Write all events available in the ring buffer (consumer side). Returns
+ * true if at least one was written.
+ */
+{
+    bool written = false;
+
+    for (;;)
+    {
+        Memory_Trace_Event *event = &ring[dequeue_position & (ring_size - 1)];
+        if (Trace_Read(&event->sequence) != dequeue_position + 1)
+            break;
+        Trace_Barrier();
+
+        fprintf(file, "%.9f,%ld,%lu,%d,", event->time, (long) event->delta, (unsigned long) event->usage, event->tag);
+        if (event->phase >= 0)
+        {
+            pthread_mutex_lock(&phases_lock);
+            fprintf(file, "%s", phases[event->phase].c_str());
+            pthread_mutex_unlock(&phases_lock);
+        }
+        fprintf(file, "\n");
+
+        Trace_Barrier();
+        event->sequence = dequeue_position + ring_size;     // Slot free for the next turn
+        dequeue_position++;
+        nb_written++;
+        written = true;
+    }
+
+    if (written)
+        fflush(file);
+
+    return written;
+}
+
+// **************************************************************
+void * Memory_Trace::Writer_Main(void *trace)
+/**
+ * Background thread: write the events every "flush_interval" seconds.
+ */
+{
+    Memory_Trace *self = static_cast<Memory_Trace *>(trace);
+
+    struct timespec delay;
+    delay.tv_sec  = time_t(self->flush_interval);
+    delay.tv_nsec = long((self->flush_interval - double(delay.tv_sec)) * 1.0e9);
+
+    while (!self->stop_writer)
+    {
+        self->Write_Pending();
+        nanosleep(&delay, NULL);
+    }
+
+    return NULL;
+}
+
+// **************************************************************
+uint64_t Memory_Trace::Get_Nb_Dropped()
+{
+    return Trace_Read(&nb_dropped);
+}
+
+// **************************************************************
+uint64_t Memory_Trace::Get_Nb_Written()
+{
+    return nb_written;
+}
+
+// ********** End of file ***************************************
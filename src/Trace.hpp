@@ -0,0 +1,84 @@
+#ifndef INC_TRACE_HPP
+#define INC_TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <pthread.h>
+
+#include "Memory.hpp"
+
+// **************************************************************
+// One change of the memory usage (or a phase marker), as pushed by the
+// allocating threads. "sequence" orders the slots of the ring buffer.
+struct Memory_Trace_Event
+{
+    uint64_t sequence;
+    double   time;      // Seconds since Start()
+    int64_t  delta;     // Bytes allocated (>0) or freed (<0)
+    uint64_t usage;     // allocated_memory's usage after the change
+    int      tag;       // Allocation tag (see Memory_Tag)
+    int      phase;     // Index of the phase name for markers (see Mark()), -1 otherwise
+};
+
+// **************************************************************
+class Memory_Trace
+/**
+ * Time-series trace of the memory usage, written as CSV:
+ *     time,delta,usage,tag,phase
+ * Allocating threads only push a small event into a lock-free ring buffer;
+ * a background thread formats and writes the events every "flush_interval"
+ * seconds. When the buffer is full, events are dropped (and counted) rather
+ * than blocking the allocating thread. Phase markers (Mark("solver")) allow
+ * lining up usage spikes with the phases of the computation.
+ * See scripts/memory_trace_summary.py to summarize a trace.
+ */
+{
+    private:
+        FILE                    *file;
+        std::string              filename;
+        Memory_Trace_Event      *ring;
+        uint64_t                 ring_size;     // Power of two
+        uint64_t                 enqueue_position;
+        uint64_t                 dequeue_position;
+        uint64_t                 nb_dropped;
+        uint64_t                 nb_written;
+        double                   flush_interval;    // Seconds
+        double                   start_time;
+        std::vector<std::string> phases;        // Already quoted for the CSV (see Mark())
+        pthread_mutex_t          phases_lock;   // Mark() can grow "phases" while the writer thread reads it
+        pthread_t                writer;
+        volatile bool            stop_writer;
+
+        static void *   Writer_Main(void *trace);
+        bool            Write_Pending();
+
+        // Not copyable
+        Memory_Trace(const Memory_Trace &other);
+        Memory_Trace & operator=(const Memory_Trace &other);
+
+    public:
+        Memory_Trace();
+        ~Memory_Trace();
+
+        bool        Start(const std::string &_filename, const double _flush_interval = 0.1, const uint64_t _ring_size = 65536);
+        void        Stop();
+        bool        Is_Running();
+
+        void        Push(const int64_t delta, const int tag, const int phase = -1);
+        void        Mark(const std::string &phase);
+
+        double      Now();
+        uint64_t    Get_Nb_Dropped();
+        uint64_t    Get_Nb_Written();
+};
+
+// Hook called by Memory_Allocation while a trace is running.
+extern bool memory_tracing;
+void Memory_Trace_Event_Hook(const int64_t delta, const int tag);
+
+extern Memory_Trace memory_trace;
+
+#endif // INC_TRACE_HPP
+
+// ********** End of file ***************************************
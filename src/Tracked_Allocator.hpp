@@ -0,0 +1,124 @@
+#ifndef INC_TRACKED_ALLOCATOR_HPP
+#define INC_TRACKED_ALLOCATOR_HPP
+
+#include <cstddef>  // size_t, ptrdiff_t
+#include <new>      // std::bad_alloc, placement new
+
+#include "Memory.hpp"
+
+// Define MEMORY_UNTRACKED_CONTAINERS to make Tracked_Allocator a plain
+// operator new/delete allocator (same code as std::allocator).
+
+// **************************************************************
+template <class T>
+class Tracked_Allocator
+/**
+ * Standard (C++98) allocator for the STL containers, going through
+ * alloc_and_check()/free_me() with the exact sizes so that containers are
+ * accounted for (under the "STL containers" allocation tag) and limited
+ * like any other tracked array:
+ *      std::vector<double, Tracked_Allocator<double> > v;
+ *      std::map<int, double, std::less<int>, Tracked_Allocator<std::pair<const int, double> > > m;
+ * Stateless: all instances are equal. When the allocation is refused (see
+ * Memory_Over_Limit_Policy), std::bad_alloc is thrown.
+ */
+{
+    public:
+    typedef T               value_type;
+    typedef T *             pointer;
+    typedef const T *       const_pointer;
+    typedef T &             reference;
+    typedef const T &       const_reference;
+    typedef size_t          size_type;
+    typedef ptrdiff_t       difference_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef Tracked_Allocator<U> other;
+    };
+
+    Tracked_Allocator() {}
+    Tracked_Allocator(const Tracked_Allocator &) {}
+    template <class U>
+    Tracked_Allocator(const Tracked_Allocator<U> &) {}
+
+    pointer         address(reference x) const          { return &x; }
+    const_pointer   address(const_reference x) const    { return &x; }
+    size_type       max_size() const                    { return size_type(-1) / sizeof(T); }
+
+    void            construct(pointer p, const T &value) { new(static_cast<void *>(p)) T(value); }
+    void            destroy(pointer p)                   { p->~T(); }
+
+    // **************************************************************
+    pointer allocate(size_type nb, const void * = 0)
+    {
+        if (nb == 0)
+            return NULL;
+        if (nb > max_size())
+            throw std::bad_alloc();
+#ifdef MEMORY_UNTRACKED_CONTAINERS
+        return static_cast<pointer>(::operator new(nb * sizeof(T)));
+#else // #ifdef MEMORY_UNTRACKED_CONTAINERS
+        pointer p = alloc_and_check<T>(nb, false, "", 0, Tag().id);
+        if (p == NULL)
+            throw std::bad_alloc();
+        return p;
+#endif // #ifdef MEMORY_UNTRACKED_CONTAINERS
+    }
+
+    // **************************************************************
+    void deallocate(pointer p, size_type nb)
+    {
+#ifdef MEMORY_UNTRACKED_CONTAINERS
+        (void) nb;
+        ::operator delete(p);
+#else // #ifdef MEMORY_UNTRACKED_CONTAINERS
+        free_me(p, nb, Tag());
+#endif // #ifdef MEMORY_UNTRACKED_CONTAINERS
+    }
+
+    // **************************************************************
+    static Memory_Tag Tag()
+    /**
+     * All containers are accounted for under the "STL containers" allocation tag.
+     */
+    {
+        static const Memory_Tag tag = allocated_memory.Register_Tag("STL containers");
+        return tag;
+    }
+};
+
+// **************************************************************
+template <>
+class Tracked_Allocator<void>
+{
+    public:
+    typedef void            value_type;
+    typedef void *          pointer;
+    typedef const void *    const_pointer;
+
+    template <class U>
+    struct rebind
+    {
+        typedef Tracked_Allocator<U> other;
+    };
+};
+
+// **************************************************************
+template <class T, class U>
+inline bool operator==(const Tracked_Allocator<T> &, const Tracked_Allocator<U> &)
+{
+    return true;
+}
+
+// **************************************************************
+template <class T, class U>
+inline bool operator!=(const Tracked_Allocator<T> &, const Tracked_Allocator<U> &)
+{
+    return false;
+}
+
+#endif // INC_TRACKED_ALLOCATOR_HPP
+
+// ********** End of file ***************************************
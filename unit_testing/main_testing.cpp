@@ -3,8 +3,33 @@
 #include <boost/test/unit_test.hpp>
 
 #include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <vector>
+#ifdef __GNUC__
+#include <tr1/unordered_map>
+#endif // #ifdef __GNUC__
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif // #ifdef _OPENMP
+
+#include "Arena.hpp"
+#include "Growable_Array.hpp"
 #include "LookUpTable.hpp"
+#include "Pool.hpp"
+#include "Profiler.hpp"
+#include "Segmented_LookUpTable.hpp"
+#include "Trace.hpp"
+#include "Tracked_Allocator.hpp"
 #include "Memory.hpp"
 
 /**
@@ -84,3 +109,1226 @@ BOOST_AUTO_TEST_CASE(LookupTable)
     BOOST_CHECK(std::abs(cos_lut.read(Pi)  + 1.0)   < 1.0e-7);
     BOOST_CHECK(std::abs(cos_lut.read(Pi/2.0))      < 1.0e-7);
 }
+
+BOOST_AUTO_TEST_CASE(ThreadSafeAccounting)
+{
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+
+    // Many threads allocating and freeing: accounting must come back to the same value.
+    #pragma omp parallel for
+    for (int i = 0 ; i < 100000 ; i++)
+    {
+        double *p = malloc_and_check<double>(16, "ThreadSafeAccounting");
+        free_me(p, 16);
+    }
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // A reservation going over the limit fails and leaves the counter untouched.
+    allocated_memory.Set_Max_Bytes(before + 1024);
+    BOOST_CHECK( allocated_memory.Reserve_Bytes(512));
+    BOOST_CHECK(!allocated_memory.Reserve_Bytes(512));
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 512);
+    allocated_memory -= 512;
+
+    // A refused reservation never makes others (that fit) fail, even transiently.
+    allocated_memory.Set_Max_Bytes(before + 1000);
+    int nb_wrongly_refused = 0;
+    #pragma omp parallel for schedule(static, 1) num_threads(4) reduction(+:nb_wrongly_refused)
+    for (int t = 0 ; t < 4 ; t++)
+    {
+        for (int i = 0 ; i < 100000 ; i++)
+        {
+            if (t == 0)
+                allocated_memory.Reserve_Bytes(2000);
+            else if (allocated_memory.Reserve_Bytes(10))
+                allocated_memory -= 10;
+            else
+                nb_wrongly_refused++;
+        }
+    }
+    BOOST_CHECK(nb_wrongly_refused == 0);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+}
+
+BOOST_AUTO_TEST_CASE(ShardedAccounting)
+{
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+
+    allocated_memory.Enable_Sharded_Counters(1024*1024);
+    BOOST_CHECK(allocated_memory.Are_Counters_Sharded());
+
+    #pragma omp parallel for
+    for (int i = 0 ; i < 100000 ; i++)
+    {
+        double *p = malloc_and_check<double>(16, "ShardedAccounting");
+        free_me(p, 16);
+    }
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    allocated_memory.Disable_Sharded_Counters();
+    BOOST_CHECK(!allocated_memory.Are_Counters_Sharded());
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // Close to the limit, reservations are exact (no chunk can be taken).
+    allocated_memory.Enable_Sharded_Counters(1024*1024);
+    allocated_memory.Set_Max_Bytes(before + 1024);
+    BOOST_CHECK( allocated_memory.Reserve_Bytes(512));
+    BOOST_CHECK(!allocated_memory.Reserve_Bytes(512));
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 512);
+    allocated_memory -= 512;
+    allocated_memory.Disable_Sharded_Counters();
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+}
+
+BOOST_AUTO_TEST_CASE(SizeHeader)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+
+    double *p = malloc_and_check<double>(1000, "SizeHeader");
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 1000*sizeof(double));
+#ifdef MEMORY_SIZE_HEADER
+    BOOST_CHECK(Get_Allocation_Size(p) == 1000*sizeof(double));
+    // The number of elements is not needed anymore.
+    free_me(p);
+#else // #ifdef MEMORY_SIZE_HEADER
+    free_me(p, 1000);
+#endif // #ifdef MEMORY_SIZE_HEADER
+    BOOST_CHECK(p == NULL);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+}
+
+BOOST_AUTO_TEST_CASE(AlignedAllocation)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+
+    double *p = calloc_and_check_aligned<double>(1001, "AlignedAllocation");
+    BOOST_CHECK((uintptr_t(p) % MEMORY_ALIGNMENT) == 0);
+    BOOST_CHECK(Is_Value_Close_To_Zero(p[0], 1.0e-300) && Is_Value_Close_To_Zero(p[1000], 1.0e-300));
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 1001*sizeof(double));
+    free_me(p, 1001);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    float *q = malloc_and_check_aligned<float>(17, "AlignedAllocation", 4096);
+    BOOST_CHECK((uintptr_t(q) % 4096) == 0);
+    free_me(q, 17);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // Lookup tables are aligned by default.
+    LookUpTable<double> lut(NULL, 0.0, 1.0, 100, "Aligned lookup table");
+    BOOST_CHECK((uintptr_t(lut.Get_Pointer()) % MEMORY_ALIGNMENT) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ArenaAllocation)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    {
+        Arena arena(4096, "Test arena");
+
+        // Many small buffers: charged once per chunk.
+        for (int i = 0 ; i < 100 ; i++)
+        {
+            double *p = arena.Allocate<double>(3);
+            BOOST_CHECK((uintptr_t(p) % 16) == 0);
+            p[0] = p[1] = p[2] = double(i);
+        }
+        BOOST_CHECK(arena.Get_Nb_Allocations() == 100);
+        BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + arena.Get_Bytes_Reserved());
+
+        // Larger than a chunk
+        char *big = arena.Allocate<char>(10000, 64);
+        BOOST_CHECK(big != NULL && (uintptr_t(big) % 64) == 0);
+        const int nb_chunks = arena.Get_Nb_Chunks();
+        const uint64_t reserved = arena.Get_Bytes_Reserved();
+
+        // After a reset, the same allocations re-use the chunks.
+        arena.Reset();
+        BOOST_CHECK(arena.Get_Bytes_Used() == 0);
+        for (int i = 0 ; i < 100 ; i++)
+            arena.Allocate<double>(3);
+        arena.Allocate<char>(10000, 64);
+        BOOST_CHECK(arena.Get_Nb_Chunks() == nb_chunks);
+        BOOST_CHECK(arena.Get_Bytes_Reserved() == reserved);
+
+        arena.Release();
+        BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+        // Usable again after a release; memory is given back by the destructor.
+        arena.Allocate<int>(10);
+        BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() > before);
+    }
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+}
+
+struct Test_Particle
+{
+    double x[3];
+    double v[3];
+    int    id;
+};
+
+BOOST_AUTO_TEST_CASE(PoolAllocation)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    {
+        Pool<Test_Particle> pool("Particles", 256);
+
+        std::vector<Test_Particle *> particles(1000);
+        for (int i = 0 ; i < 1000 ; i++)
+        {
+            particles[i] = pool.Allocate();
+            particles[i]->id = i;
+        }
+        BOOST_CHECK(pool.Get_Nb_Live() == 1000);
+        BOOST_CHECK(pool.Get_Capacity() >= 1000);
+        for (int i = 0 ; i < 1000 ; i++)
+            BOOST_CHECK(particles[i]->id == i);
+        allocated_memory.Print();
+
+        const uint64_t capacity = pool.Get_Capacity();
+        for (int i = 0 ; i < 1000 ; i++)
+            pool.Free(particles[i]);
+        BOOST_CHECK(pool.Get_Nb_Live() == 0);
+
+        // Freed objects are recycled: no new slab is needed.
+        #pragma omp parallel for
+        for (int i = 0 ; i < 1000 ; i++)
+        {
+            Test_Particle *p = pool.Allocate();
+            p->id = i;
+            pool.Free(p);
+        }
+        BOOST_CHECK(pool.Get_Nb_Live() == 0);
+        BOOST_CHECK(pool.Get_Capacity() == capacity);
+
+#ifdef _OPENMP
+        // More threads than caches: the extra ones use the shared list and
+        // never get an object another thread holds.
+        int nb_errors = 0;
+        #pragma omp parallel num_threads(omp_get_max_threads() + 2) reduction(+:nb_errors)
+        {
+            std::vector<Test_Particle *> mine(100);
+            for (int i = 0 ; i < 100 ; i++)
+            {
+                mine[i] = pool.Allocate();
+                mine[i]->id = 1000 * omp_get_thread_num() + i;
+            }
+            #pragma omp barrier
+            for (int i = 0 ; i < 100 ; i++)
+            {
+                if (mine[i]->id != 1000 * omp_get_thread_num() + i)
+                    nb_errors++;
+                pool.Free(mine[i]);
+            }
+        }
+        BOOST_CHECK(nb_errors == 0);
+        BOOST_CHECK(pool.Get_Nb_Live() == 0);
+#endif // #ifdef _OPENMP
+    }
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+}
+
+static double *test_cache = NULL;
+static bool Test_Free_Cache(const uint64_t bytes_needed, void *user_data)
+{
+    if (test_cache == NULL)
+        return false;
+    free_me(test_cache, 1000);
+    (*((int *) user_data))++;
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(OverLimitPolicies)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    const Memory_Over_Limit_Policy default_policy = allocated_memory.Get_Over_Limit_Policy();
+
+    allocated_memory.Set_Max_Bytes(before + 10000);
+
+    // Return NULL: nothing is charged.
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_RETURN_NULL);
+    double *p = malloc_and_check<double>(2000, "OverLimitPolicies");
+    BOOST_CHECK(p == NULL);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // Throw
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_THROW);
+    BOOST_CHECK_THROW(malloc_and_check<double>(2000, "OverLimitPolicies"), std::bad_alloc);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // Callback freeing a cache, then the allocation is retried.
+    int nb_calls = 0;
+    test_cache = malloc_and_check<double>(1000, "OverLimitPolicies cache");
+    allocated_memory.Set_Over_Limit_Callback(Test_Free_Cache, &nb_calls);
+    p = malloc_and_check<double>(500, "OverLimitPolicies");
+    BOOST_CHECK(p != NULL);
+    BOOST_CHECK(nb_calls == 1);
+    BOOST_CHECK(test_cache == NULL);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 500*sizeof(double));
+    free_me(p, 500);
+
+    // Wait: memory is available right away.
+    allocated_memory.Set_Over_Limit_Timeout(0.01);
+    BOOST_CHECK(allocated_memory.Get_Over_Limit_Policy() == MEMORY_POLICY_WAIT);
+    p = malloc_and_check<double>(500, "OverLimitPolicies");
+    BOOST_CHECK(p != NULL);
+    free_me(p, 500);
+
+#ifdef _OPENMP
+    // Wait: another thread frees memory while we wait.
+    allocated_memory.Set_Over_Limit_Timeout(10.0);
+    double *held = malloc_and_check<double>(1000, "OverLimitPolicies held");
+    p = NULL;
+    #pragma omp parallel num_threads(2)
+    {
+        if (omp_get_thread_num() == 0)
+            p = malloc_and_check<double>(500, "OverLimitPolicies");
+        else
+        {
+            struct timespec delay;
+            delay.tv_sec  = 0;
+            delay.tv_nsec = 20000000;
+            nanosleep(&delay, NULL);
+            free_me(held, 1000);
+        }
+    }
+    BOOST_CHECK(p != NULL);
+    free_me(p, 500);
+#endif // #ifdef _OPENMP
+
+    // Wait: nothing is freed, the timeout expires and the process aborts.
+    allocated_memory.Set_Over_Limit_Timeout(0.05);
+    struct timeval start, stop;
+    gettimeofday(&start, NULL);
+    const pid_t child = fork();
+    if (child == 0)
+    {
+        // Boost.Test catches SIGABRT: let the child die.
+        signal(SIGABRT, SIG_DFL);
+        malloc_and_check<double>(2000, "OverLimitPolicies (expected to abort)");
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    gettimeofday(&stop, NULL);
+    BOOST_CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+    BOOST_CHECK(double(stop.tv_sec - start.tv_sec) + 1.0e-6 * double(stop.tv_usec - start.tv_usec) >= 0.05);
+
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+    allocated_memory.Set_Over_Limit_Policy(default_policy);
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+}
+
+static double Test_Linear(double x)
+{
+    return x;
+}
+
+BOOST_AUTO_TEST_CASE(RefusedAllocations)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    const Memory_Over_Limit_Policy default_policy = allocated_memory.Get_Over_Limit_Policy();
+
+    // The system allocation fails: the policy applies too.
+    const uint64_t too_large = uint64_t(1) << 58;
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_RETURN_NULL);
+    BOOST_CHECK(malloc_and_check<double>(too_large, "RefusedAllocations (expected to fail)") == NULL);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_THROW);
+    BOOST_CHECK_THROW(malloc_and_check<double>(too_large, "RefusedAllocations (expected to fail)"), std::bad_alloc);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // Containers built on alloc_and_check() propagate refusals.
+    Arena arena(4096, "RefusedAllocations arena");
+    Pool<double> pool("RefusedAllocations pool", 1024);
+    const uint64_t with_pool = allocated_memory.Get_Bytes_Allocated();
+    allocated_memory.Set_Max_Bytes(with_pool + 1000);
+
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_RETURN_NULL);
+    BOOST_CHECK(arena.Allocate<double>(10) == NULL);
+    BOOST_CHECK(arena.Get_Nb_Chunks() == 0);
+    BOOST_CHECK(pool.Allocate() == NULL);
+    BOOST_CHECK(pool.Get_Capacity() == 0);
+    LookUpTable<double> lut(Test_Linear, 0.0, 10.0, 1000, "RefusedAllocations lookup table");
+    BOOST_CHECK(!lut.Is_Initialized());
+
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_THROW);
+    BOOST_CHECK_THROW(pool.Allocate(), std::bad_alloc);
+    // The pool is still usable once memory is available.
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+    double *d = pool.Allocate();
+    BOOST_CHECK(d != NULL);
+    pool.Free(d);
+
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() > with_pool);
+
+    // A pool whose caches were refused still works, through its shared list.
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_RETURN_NULL);
+    allocated_memory.Set_Max_Bytes(allocated_memory.Get_Bytes_Allocated() + 1);
+    {
+        Pool<double> no_caches("RefusedAllocations pool without caches", 16);
+        allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+        double *objects[40];
+        for (int i = 0 ; i < 40 ; i++)
+        {
+            objects[i] = no_caches.Allocate();
+            BOOST_CHECK(objects[i] != NULL);
+        }
+        BOOST_CHECK(no_caches.Get_Nb_Live() == 40);
+        for (int i = 0 ; i < 40 ; i++)
+            no_caches.Free(objects[i]);
+        BOOST_CHECK(no_caches.Get_Nb_Live() == 0);
+    }
+    allocated_memory.Set_Over_Limit_Policy(default_policy);
+}
+
+struct Test_Shrinkable_Cache
+{
+    double *data;
+    int     nb;
+    int     order;  // Order in which the shrinker was called (0 if not)
+};
+static int test_shrinker_calls = 0;
+static uint64_t Test_Shrink_Cache(const uint64_t bytes_needed, void *user_data)
+{
+    Test_Shrinkable_Cache *cache = (Test_Shrinkable_Cache *) user_data;
+    cache->order = ++test_shrinker_calls;
+    if (cache->data == NULL)
+        return 0;
+    free_me(cache->data, cache->nb);
+    return cache->nb * sizeof(double);
+}
+
+static uint64_t Test_Shrink_Cache_Once(const uint64_t bytes_needed, void *user_data)
+{
+    // Drops its whole cache: not needed anymore.
+    allocated_memory.Unregister_Shrinker(Test_Shrink_Cache_Once, user_data);
+    return Test_Shrink_Cache(bytes_needed, user_data);
+}
+
+static int test_greedy_shrinker_calls = 0;
+static double *test_greedy_shrinker_result = NULL;
+static uint64_t Test_Greedy_Shrinker(const uint64_t bytes_needed, void *user_data)
+{
+    // Allocates over the limit itself: must not call the shrinkers again.
+    test_greedy_shrinker_calls++;
+    test_greedy_shrinker_result = malloc_and_check<double>(2000, "Greedy shrinker");
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE(Shrinkers)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    const Memory_Over_Limit_Policy default_policy = allocated_memory.Get_Over_Limit_Policy();
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_RETURN_NULL);
+    allocated_memory.Set_Max_Bytes(before + 10000);
+
+    Test_Shrinkable_Cache small = {NULL, 100, 0};
+    Test_Shrinkable_Cache large = {NULL, 1000, 0};
+    Test_Shrinkable_Cache other = {NULL, 100, 0};
+    small.data = malloc_and_check<double>(small.nb, "Shrinkers");
+    large.data = malloc_and_check<double>(large.nb, "Shrinkers");
+    other.data = malloc_and_check<double>(other.nb, "Shrinkers");
+    allocated_memory.Register_Shrinker(Test_Shrink_Cache, &other, 10);
+    allocated_memory.Register_Shrinker(Test_Shrink_Cache, &large, 1);
+    allocated_memory.Register_Shrinker(Test_Shrink_Cache, &small, 0);
+
+    // Freeing "small" is not enough, "large" is; "other" stays.
+    double *p = malloc_and_check<double>(500, "Shrinkers");
+    BOOST_CHECK(p != NULL);
+    BOOST_CHECK(small.order == 1 && small.data == NULL);
+    BOOST_CHECK(large.order == 2 && large.data == NULL);
+    BOOST_CHECK(other.order == 0 && other.data != NULL);
+
+    allocated_memory.Unregister_Shrinker(Test_Shrink_Cache, &small);
+    allocated_memory.Unregister_Shrinker(Test_Shrink_Cache, &large);
+    allocated_memory.Unregister_Shrinker(Test_Shrink_Cache, &other);
+    free_me(p, 500);
+    free_me(other.data, other.nb);
+
+    // A shrinker unregistering itself: no deadlock, the next one is still called.
+    test_shrinker_calls = 0;
+    small.order = 0;
+    large.order = 0;
+    small.data = malloc_and_check<double>(small.nb, "Shrinkers");
+    large.data = malloc_and_check<double>(large.nb, "Shrinkers");
+    allocated_memory.Register_Shrinker(Test_Shrink_Cache_Once, &small, 0);
+    allocated_memory.Register_Shrinker(Test_Shrink_Cache_Once, &large, 1);
+    p = malloc_and_check<double>(500, "Shrinkers");
+    BOOST_CHECK(p != NULL);
+    BOOST_CHECK(small.order == 1 && small.data == NULL);
+    BOOST_CHECK(large.order == 2 && large.data == NULL);
+    // Both are gone: nothing is called anymore.
+    BOOST_CHECK(malloc_and_check<double>(2000, "Shrinkers") == NULL);
+    BOOST_CHECK(test_shrinker_calls == 2);
+    free_me(p, 500);
+
+    // A shrinker allocating over the limit: no deadlock nor recursion.
+    allocated_memory.Register_Shrinker(Test_Greedy_Shrinker);
+    BOOST_CHECK(malloc_and_check<double>(2000, "Shrinkers") == NULL);
+    BOOST_CHECK(test_greedy_shrinker_calls == 1);
+    BOOST_CHECK(test_greedy_shrinker_result == NULL);
+    // Its exception leaves the critical section before being thrown again.
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_THROW);
+    BOOST_CHECK_THROW(malloc_and_check<double>(2000, "Shrinkers"), std::bad_alloc);
+    BOOST_CHECK_THROW(malloc_and_check<double>(2000, "Shrinkers"), std::bad_alloc);
+    BOOST_CHECK(test_greedy_shrinker_calls == 3);
+    allocated_memory.Unregister_Shrinker(Test_Greedy_Shrinker);
+
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+    allocated_memory.Set_Over_Limit_Policy(default_policy);
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(Statistics)
+{
+    allocated_memory.Enable_Statistics();
+    const uint64_t nb_allocations = allocated_memory.Get_Nb_Allocations();
+    const uint64_t nb_frees       = allocated_memory.Get_Nb_Frees();
+    const uint64_t total          = allocated_memory.Get_Total_Bytes_Allocated();
+    const uint64_t histogram      = allocated_memory.Get_Size_Histogram(12);   // [4096, 8192)
+
+    allocated_memory.Reset_Peak();
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    BOOST_CHECK(allocated_memory.Get_Peak_Bytes() == before);
+
+    double *a = malloc_and_check<double>(1000, "Statistics");   // 8000 bytes
+    double *b = malloc_and_check<double>(1000, "Statistics");
+    free_me(a, 1000);
+    free_me(b, 1000);
+    double *c = malloc_and_check<double>(100, "Statistics");
+    free_me(c, 100);
+
+    BOOST_CHECK(allocated_memory.Get_Peak_Bytes() == before + 16000);
+    BOOST_CHECK(allocated_memory.Get_Nb_Allocations() == nb_allocations + 3);
+    BOOST_CHECK(allocated_memory.Get_Nb_Frees() == nb_frees + 3);
+    BOOST_CHECK(allocated_memory.Get_Total_Bytes_Allocated() == total + 16800);
+    BOOST_CHECK(allocated_memory.Get_Size_Histogram(12) == histogram + 2);
+    BOOST_CHECK(allocated_memory.Get_Allocation_Rate() >= 0.0);
+
+    allocated_memory.Reset_Peak();
+    BOOST_CHECK(allocated_memory.Get_Peak_Bytes() == before);
+
+    // The shards' unused budgets are not part of the peak.
+    allocated_memory.Enable_Sharded_Counters(1024*1024);
+    allocated_memory.Reset_Peak();
+    c = malloc_and_check<double>(100, "Statistics");
+    BOOST_CHECK(allocated_memory.Get_Peak_Bytes() == before + 800);
+    free_me(c, 100);
+    allocated_memory.Disable_Sharded_Counters();
+
+    // Nor are refused reservations.
+    allocated_memory.Set_Max_Bytes(before + 1000);
+    allocated_memory.Reset_Peak();
+    BOOST_CHECK( allocated_memory.Reserve_Bytes(10));
+    BOOST_CHECK(!allocated_memory.Reserve_Bytes(2000));
+    BOOST_CHECK(allocated_memory.Get_Peak_Bytes() == before + 10);
+    allocated_memory -= 10;
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+
+    // Statistics are opt-in; the peak is always kept.
+    allocated_memory.Disable_Statistics();
+    BOOST_CHECK(!allocated_memory.Are_Statistics_Enabled());
+    allocated_memory.Reset_Peak();
+    c = malloc_and_check<double>(100, "Statistics");
+    free_me(c, 100);
+    BOOST_CHECK(allocated_memory.Get_Nb_Allocations() == 0);
+    BOOST_CHECK(allocated_memory.Get_Peak_Bytes() == before + 800);
+    allocated_memory.Enable_Statistics();
+}
+
+// **************************************************************
+static void * Test_Tagged_Allocations(void *tag)
+{
+    for (int i = 0 ; i < 1000 ; i++)
+    {
+        double *p = malloc_and_check<double>(10, *((Memory_Tag *) tag));
+        free_me(p, 10, *((Memory_Tag *) tag));
+    }
+    return NULL;
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(AllocationTagsFromThreads)
+{
+    allocated_memory.Enable_Statistics();
+    // Threads that are not OpenMP ones (or more of them than at start-up)
+    // do not share a statistics slot without synchronization.
+    const Memory_Tag tag = allocated_memory.Register_Tag("Test threads");
+    pthread_t threads[4];
+    for (int t = 0 ; t < 4 ; t++)
+        pthread_create(&threads[t], NULL, Test_Tagged_Allocations, (void *) &tag);
+    for (int t = 0 ; t < 4 ; t++)
+        pthread_join(threads[t], NULL);
+    BOOST_CHECK(allocated_memory.Get_Tag_Nb_Allocations(tag) == 4000);
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(tag) == 0);
+
+#ifdef _OPENMP
+    const int nb_threads = omp_get_max_threads() + 3;
+    #pragma omp parallel num_threads(nb_threads)
+    Test_Tagged_Allocations((void *) &tag);
+    BOOST_CHECK(allocated_memory.Get_Tag_Nb_Allocations(tag) == uint64_t(4000 + 1000*nb_threads));
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(tag) == 0);
+#endif // #ifdef _OPENMP
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(AllocationTags)
+{
+    allocated_memory.Enable_Statistics();
+    const Memory_Tag particles = allocated_memory.Register_Tag("Test particles");
+    const Memory_Tag grid      = allocated_memory.Register_Tag("Test grid");
+    BOOST_CHECK(particles.id != 0 && grid.id != 0 && particles.id != grid.id);
+    BOOST_CHECK(allocated_memory.Register_Tag("Test particles").id == particles.id);
+    BOOST_CHECK(allocated_memory.Get_Tag_Name(grid) == "Test grid");
+
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+
+    double *p = malloc_and_check<double>(100, particles);
+    float  *g = calloc_and_check_aligned<float>(1000, grid);
+    double *q = malloc_and_check<double>(50, particles);
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(particles) == 1200);
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(grid) == 4000);
+    BOOST_CHECK(allocated_memory.Get_Tag_Nb_Allocations(particles) == 2);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 5200);
+
+    free_me(p, 100, particles);
+    free_me(q, 50, particles);
+    free_me(g, 1000, grid);
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(particles) == 0);
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(grid) == 0);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // Arenas are accounted for under their name
+    Arena arena(4096, "Test arena");
+    arena.Allocate<double>(10);
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(allocated_memory.Register_Tag("Test arena")) == 4096);
+    arena.Release();
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(allocated_memory.Register_Tag("Test arena")) == 0);
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(AllocationProfiler)
+{
+    // Sample every allocation (interval of 1 byte)
+    memory_profiler.Reset();
+    memory_profiler.Enable(1);
+
+    double *kept = malloc_and_check<double>(1000, "Profiler");
+    for (int i = 0 ; i < 10 ; i++)
+    {
+        double *p = malloc_and_check<double>(100, "Profiler");
+        free_me(p, 100);
+    }
+    memory_profiler.Disable();
+
+    BOOST_CHECK(memory_profiler.Get_Nb_Sites() >= 2);
+    BOOST_CHECK(Is_Value_Close_To_Zero(memory_profiler.Get_Live_Bytes() - 8000.0, 1.0e-6));
+    BOOST_CHECK(Is_Value_Close_To_Zero(memory_profiler.Get_Total_Bytes() - 16000.0, 1.0e-6));
+
+    BOOST_CHECK(memory_profiler.Dump_Pprof("memory_test_profile.heap"));
+    BOOST_CHECK(memory_profiler.Dump_Flamegraph("memory_test_profile.folded"));
+    std::ifstream heap("memory_test_profile.heap");
+    std::string first_line;
+    std::getline(heap, first_line);
+    BOOST_CHECK(first_line == "heap profile: 1: 8000 [11: 16000] @ heap");
+    remove("memory_test_profile.heap");
+    remove("memory_test_profile.folded");
+
+    free_me(kept, 1000);
+    memory_profiler.Reset();
+
+    // Block freed while profiling is disabled, its address reused once
+    // enabled again: its stale entry must not stay in the live profile.
+    memory_profiler.Enable(1);
+    double *stale = malloc_and_check<double>(1000, "Profiler");
+    const void *stale_address = stale;
+    memory_profiler.Disable();
+    free_me(stale, 1000);
+    memory_profiler.Enable(1);
+    double *reused = malloc_and_check<double>(1000, "Profiler");
+    BOOST_CHECK(reused == stale_address);   // malloc() gives the last freed block back
+    BOOST_CHECK(Is_Value_Close_To_Zero(memory_profiler.Get_Live_Bytes() - 8000.0, 1.0e-6));
+    free_me(reused, 1000);
+    memory_profiler.Disable();
+    BOOST_CHECK(Is_Value_Close_To_Zero(memory_profiler.Get_Live_Bytes(), 1.0e-6));
+    memory_profiler.Reset();
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(UsageTrace)
+{
+    BOOST_CHECK(memory_trace.Start("memory_test_trace.csv", 0.001));
+    memory_trace.Mark("phase 1");
+    double *p = malloc_and_check<double>(1000, "Trace");
+    free_me(p, 1000);
+    memory_trace.Stop();
+    BOOST_CHECK(!memory_trace.Is_Running());
+    BOOST_CHECK(memory_trace.Get_Nb_Dropped() == 0);
+    BOOST_CHECK(memory_trace.Get_Nb_Written() == 4);   // Initial usage, marker, allocation, free
+
+    std::ifstream trace("memory_test_trace.csv");
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(trace, line))
+        lines.push_back(line);
+    BOOST_CHECK(lines.size() == 5);
+    BOOST_CHECK(lines[0] == "time,delta,usage,tag,phase");
+    BOOST_CHECK(lines[2].find(",0,phase 1") != std::string::npos);
+    BOOST_CHECK(lines[3].find(",8000,") != std::string::npos);
+    BOOST_CHECK(lines[4].find(",-8000,") != std::string::npos);
+    remove("memory_test_trace.csv");
+
+    // Phase names with commas or quotes are quoted
+    BOOST_CHECK(memory_trace.Start("memory_test_trace.csv", 0.001));
+    memory_trace.Mark("a,b");
+    memory_trace.Mark("say \"hi\"");
+    memory_trace.Stop();
+    std::ifstream quoted_trace("memory_test_trace.csv");
+    lines.clear();
+    while (std::getline(quoted_trace, line))
+        lines.push_back(line);
+    BOOST_CHECK(lines.size() == 4);
+    BOOST_CHECK(lines[2].find(",0,\"a,b\"") != std::string::npos);
+    BOOST_CHECK(lines[3].find(",0,\"say \"\"hi\"\"\"") != std::string::npos);
+    remove("memory_test_trace.csv");
+
+    // Many markers while the writer thread runs
+    BOOST_CHECK(memory_trace.Start("memory_test_trace.csv", 0.0001));
+    for (int i = 0 ; i < 2000 ; i++)
+    {
+        std::ostringstream phase;
+        phase << "step " << i;
+        memory_trace.Mark(phase.str());
+        double *q = malloc_and_check<double>(10, "Trace");
+        free_me(q, 10);
+    }
+    memory_trace.Stop();
+    BOOST_CHECK(memory_trace.Get_Nb_Dropped() == 0);
+    std::ifstream marked_trace("memory_test_trace.csv");
+    int nb_markers = 0;
+    while (std::getline(marked_trace, line))
+    {
+        std::ostringstream expected;
+        expected << ",0,step " << nb_markers;
+        if (line.find(expected.str()) != std::string::npos)
+            nb_markers++;
+    }
+    BOOST_CHECK(nb_markers == 2000);
+    remove("memory_test_trace.csv");
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(LiveBlocksRegistry)
+{
+    allocated_memory.Enable_Live_Registry(false);
+    const uint64_t nb_blocks = allocated_memory.Get_Nb_Live_Blocks();
+    const uint64_t bytes     = allocated_memory.Get_Live_Block_Bytes();
+
+    const Memory_Tag tag = allocated_memory.Register_Tag("Test leaks");
+    std::vector<double *> pointers;
+    for (int i = 0 ; i < 1000 ; i++)
+        pointers.push_back(malloc_and_check<double>(i + 1, tag));
+    BOOST_CHECK(allocated_memory.Get_Nb_Live_Blocks() == nb_blocks + 1000);
+    BOOST_CHECK(allocated_memory.Get_Live_Block_Bytes() == bytes + 8 * 1000 * 1001 / 2);
+
+    // Free in a different order than allocated
+    for (int i = 0 ; i < 1000 ; i += 2)
+        free_me(pointers[i], i + 1, tag);
+    for (int i = 999 ; i > 0 ; i -= 2)
+        free_me(pointers[i], i + 1, tag);
+    BOOST_CHECK(allocated_memory.Get_Nb_Live_Blocks() == nb_blocks);
+    BOOST_CHECK(allocated_memory.Get_Live_Block_Bytes() == bytes);
+
+    double *leak = malloc_and_check<double>(10, tag);
+    BOOST_CHECK(allocated_memory.Get_Nb_Live_Blocks() == nb_blocks + 1);
+    allocated_memory.Report_Live();
+    free_me(leak, 10, tag);
+    BOOST_CHECK(allocated_memory.Get_Nb_Live_Blocks() == nb_blocks);
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(MmapLargeAllocations)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    allocated_memory.Set_Mmap_Threshold(MiBytes_to_Bytes(1));
+
+    const int n = 1 << 18;  // 2 MiB of doubles
+    double *large   = calloc_and_check<double>(n, "Mmap");
+    double *aligned = calloc_and_check_aligned<double>(n, "Mmap");
+    double *small   = calloc_and_check<double>(100, "Mmap");
+    BOOST_CHECK(allocated_memory.Get_Nb_Mmap_Blocks() == 2);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 2*n*sizeof(double) + 100*sizeof(double));
+    BOOST_CHECK(uintptr_t(aligned) % MEMORY_ALIGNMENT == 0);
+    BOOST_CHECK(Is_Value_Close_To_Zero(large[0], 1.0e-300) && Is_Value_Close_To_Zero(large[n-1], 1.0e-300));
+    BOOST_CHECK(Is_Value_Close_To_Zero(aligned[n-1], 1.0e-300));
+    large[n-1] = 1.0;
+
+    free_me(large, n);
+    free_me(aligned, n);
+    free_me(small, 100);
+    BOOST_CHECK(allocated_memory.Get_Nb_Mmap_Blocks() == 0);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    allocated_memory.Set_Mmap_Threshold(0);
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(ParallelClear)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    allocated_memory.Set_Parallel_Clear_Threshold(MiBytes_to_Bytes(1));
+
+    // Odd size: unaligned tail
+    const int n = (1 << 21) + 13;
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        char *dirty = malloc_and_check<char>(n, "ParallelClear");
+        memset(dirty, 0xFF, n);
+        free_me(dirty, n);
+
+        char *p = (i == 0 ? calloc_and_check<char>(n, "ParallelClear") : calloc_and_check_aligned<char>(n, "ParallelClear"));
+        BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + n);
+        int nb_non_zero = 0;
+        for (int j = 0 ; j < n ; j++)
+        {
+            if (p[j] != 0)
+                nb_non_zero++;
+        }
+        BOOST_CHECK(nb_non_zero == 0);
+        free_me(p, n);
+    }
+
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+    allocated_memory.Set_Parallel_Clear_Threshold(0);
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(MappedFiles)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    const std::string filename("memory_test_mapped.bin");
+    const int n = 100000;
+
+    double *p = map_file_and_check<double>(filename, n, MEMORY_FILE_CREATE, "MappedFiles");
+    BOOST_REQUIRE(p != NULL);
+    BOOST_CHECK(allocated_memory.Get_Mapped_Bytes() == n*sizeof(double));
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+    advise_mapped_file(p, 0, n, MEMORY_FILE_SEQUENTIAL);
+    for (int i = 0 ; i < n ; i++)
+        p[i] = double(i);
+    BOOST_CHECK(sync_mapped_file(p, n));
+    unmap_file(p, n);
+    BOOST_CHECK(p == NULL);
+    BOOST_CHECK(allocated_memory.Get_Mapped_Bytes() == 0);
+
+    // Read back
+    const double *q = map_file_and_check<const double>(filename, n, MEMORY_FILE_READ);
+    BOOST_REQUIRE(q != NULL);
+    advise_mapped_file(q, n/2, n/2, MEMORY_FILE_WILLNEED);
+    BOOST_CHECK(Is_Value_Close_To_Zero(q[0], 1.0e-300));
+    BOOST_CHECK(Is_Value_Close_To_Zero(q[n-1] - double(n-1), 1.0e-10));
+    unmap_file(q, n);
+
+    // Over the budget, missing or too small file
+    const Memory_Over_Limit_Policy policy = allocated_memory.Get_Over_Limit_Policy();
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_RETURN_NULL);
+    allocated_memory.Set_Max_Mapped_Bytes(n*sizeof(double) - 1);
+    BOOST_CHECK(map_file_and_check<double>(filename, n) == NULL);
+    // Budget lowered under what is already mapped: nothing else fits.
+    allocated_memory.Set_Max_Mapped_Bytes(std::numeric_limits<uint64_t>::max());
+    double *r = map_file_and_check<double>(filename, n);
+    BOOST_REQUIRE(r != NULL);
+    allocated_memory.Set_Max_Mapped_Bytes(n*sizeof(double) / 2);
+    BOOST_CHECK(map_file_and_check<double>(filename, 1) == NULL);
+    unmap_file(r, n);
+    allocated_memory.Set_Max_Mapped_Bytes(std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK(map_file_and_check<double>(filename, 2*n, MEMORY_FILE_READ) == NULL);
+    BOOST_CHECK(map_file_and_check<double>("memory_test_missing.bin", n, MEMORY_FILE_READ) == NULL);
+    BOOST_CHECK(allocated_memory.Get_Mapped_Bytes() == 0);
+    allocated_memory.Set_Over_Limit_Policy(policy);
+
+    remove(filename.c_str());
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(Realloc)
+{
+    allocated_memory.Enable_Statistics();
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+
+    int *p = realloc_and_check<int>(NULL, 0, 100, "Realloc");
+    for (int i = 0 ; i < 100 ; i++)
+        p[i] = i;
+    p = realloc_and_check(p, 100, 10000, "Realloc");
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 10000*sizeof(int));
+    p = realloc_and_check(p, 10000, 50, "Realloc");
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 50*sizeof(int));
+    BOOST_CHECK(p[0] == 0 && p[49] == 49);
+
+    // Aligned
+    double *a = malloc_and_check_aligned<double>(10, "Realloc");
+    a[9] = 9.0;
+    a = realloc_and_check(a, 10, 1000, "Realloc", Memory_Tag(), MEMORY_ALIGNMENT);
+    BOOST_CHECK(uintptr_t(a) % MEMORY_ALIGNMENT == 0);
+    BOOST_CHECK(Is_Value_Close_To_Zero(a[9] - 9.0, 1.0e-10));
+
+    // Moved to mmap() once, then mremap()ed
+    allocated_memory.Set_Mmap_Threshold(MiBytes_to_Bytes(1));
+    const int n = 1 << 18;  // 1 MiB of ints
+    p = realloc_and_check(p, 50, n, "Realloc");
+    BOOST_CHECK(allocated_memory.Get_Nb_Mmap_Blocks() == 1);
+    p[n-1] = n-1;
+    p = realloc_and_check(p, n, 4*n, "Realloc");
+    BOOST_CHECK(allocated_memory.Get_Nb_Mmap_Blocks() == 1);
+    BOOST_CHECK(p[49] == 49 && p[n-1] == n-1);
+    p[4*n-1] = 1;
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + 4*n*sizeof(int) + 1000*sizeof(double));
+    allocated_memory.Set_Mmap_Threshold(0);
+
+    p = realloc_and_check(p, 4*n, 0, "Realloc");
+    BOOST_CHECK(p == NULL);
+    BOOST_CHECK(allocated_memory.Get_Nb_Mmap_Blocks() == 0);
+    free_me(a, 1000);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // Growable array
+    {
+        Growable_Array<int> array("Realloc array");
+        for (int i = 0 ; i < 100000 ; i++)
+            BOOST_CHECK(array.Push_Back(i));
+        BOOST_CHECK(array.Get_Size() == 100000);
+        BOOST_CHECK(array.Get_Capacity() >= 100000 && array.Get_Capacity() < 200000);
+        BOOST_CHECK(array[0] == 0 && array[99999] == 99999);
+        array.Shrink_To_Fit();
+        BOOST_CHECK(allocated_memory.Get_Tag_Bytes(allocated_memory.Register_Tag("Realloc array")) == int64_t(100000*sizeof(int)));
+    }
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(TrackedAllocator)
+{
+    allocated_memory.Enable_Statistics();
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    const Memory_Tag tag = Tracked_Allocator<int>::Tag();
+
+    {
+        std::vector<double, Tracked_Allocator<double> > v;
+        v.reserve(1000);
+        BOOST_CHECK(allocated_memory.Get_Tag_Bytes(tag) == int64_t(1000*sizeof(double)));
+        for (int i = 0 ; i < 2000 ; i++)
+            v.push_back(double(i));
+        BOOST_CHECK(allocated_memory.Get_Tag_Bytes(tag) == int64_t(v.capacity()*sizeof(double)));
+
+        std::map<int, double, std::less<int>, Tracked_Allocator<std::pair<const int, double> > > m;
+        const int64_t before_map = allocated_memory.Get_Tag_Bytes(tag);
+        for (int i = 0 ; i < 100 ; i++)
+            m[i] = double(i);
+        BOOST_CHECK(allocated_memory.Get_Tag_Bytes(tag) > before_map + int64_t(100*sizeof(std::pair<const int, double>)));
+        m.clear();
+        BOOST_CHECK(allocated_memory.Get_Tag_Bytes(tag) == before_map);
+
+#ifdef __GNUC__
+        std::tr1::unordered_map<int, double, std::tr1::hash<int>, std::equal_to<int>, Tracked_Allocator<std::pair<const int, double> > > u;
+        for (int i = 0 ; i < 100 ; i++)
+            u[i] = double(i);
+        BOOST_CHECK(allocated_memory.Get_Tag_Bytes(tag) > before_map);
+        BOOST_CHECK(Is_Value_Close_To_Zero(u[99] - 99.0, 1.0e-10));
+#endif // #ifdef __GNUC__
+    }
+    BOOST_CHECK(allocated_memory.Get_Tag_Bytes(tag) == 0);
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+
+    // Containers are limited too.
+    const Memory_Over_Limit_Policy default_policy = allocated_memory.Get_Over_Limit_Policy();
+    allocated_memory.Set_Over_Limit_Policy(MEMORY_POLICY_RETURN_NULL);
+    allocated_memory.Set_Max_Bytes(before + 10000);
+    std::vector<double, Tracked_Allocator<double> > v;
+    BOOST_CHECK_THROW(v.resize(2000), std::bad_alloc);
+    allocated_memory.Set_Over_Limit_Policy(default_policy);
+    allocated_memory.Set_Max_Bytes(std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(NUMAPlacement)
+{
+    const uint64_t before = allocated_memory.Get_Bytes_Allocated();
+    BOOST_CHECK(allocated_memory.Get_NUMA_Nb_Nodes() >= 1);
+
+    const int n = 1000000;
+    const Memory_NUMA_Placement placements[3] = {MEMORY_NUMA_LOCAL, MEMORY_NUMA_INTERLEAVE, MEMORY_NUMA_FIRST_TOUCH};
+    for (int i = 0 ; i < 3 ; i++)
+    {
+        double *p = calloc_and_check_numa<double>(n, placements[i], "NUMA");
+        BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before + n*sizeof(double));
+
+        int nb_non_zero = 0;
+        #pragma omp parallel for schedule(static) reduction(+:nb_non_zero)
+        for (int j = 0 ; j < n ; j++)
+        {
+            if (!Is_Value_Close_To_Zero(p[j], 1.0e-300))
+                nb_non_zero++;
+            p[j] = double(j);
+        }
+        BOOST_CHECK(nb_non_zero == 0);
+
+        free_me(p, n);
+    }
+
+    BOOST_CHECK(allocated_memory.Get_Bytes_Allocated() == before);
+    // Kernels without NUMA support (CONFIG_NUMA) have no numa_maps.
+    if (std::ifstream("/proc/self/numa_maps").good())
+        BOOST_CHECK(allocated_memory.Get_NUMA_Node_Bytes(0) > 0);
+}
+
+// **************************************************************
+template <class Double>
+static Double Test_Exp(Double x)
+{
+    return Double(std::exp(-double(x)));
+}
+
+// **************************************************************
+template <class Double>
+static void Test_Read_Batch()
+{
+    LookUpTable<Double> lut(Test_Exp<Double>, Double(0.0), Double(10.0), 1000, "Batch lookup table");
+    LookUpTable<Double> pairs(Test_Exp<Double>, Double(0.0), Double(10.0), 1000, "Batch lookup table", NULL, LUT_LAYOUT_INTERLEAVED);
+    BOOST_CHECK(pairs.Get_Layout() == LUT_LAYOUT_INTERLEAVED);
+
+    // Odd number of points: SIMD part and scalar tail
+    const int n = 10007;
+    Double *x   = malloc_and_check<Double>(n, "Read batch");
+    Double *out = malloc_and_check<Double>(n, "Read batch");
+    Double *par = malloc_and_check<Double>(n, "Read batch");
+    Double *pai = malloc_and_check<Double>(n, "Read batch");
+    for (int i = 0 ; i < n ; i++)
+        x[i] = Double(9.99) * Double((i * 7919) % n) / Double(n);
+
+    lut.read_batch(x, out, n);
+    lut.read_batch_parallel(x, par, n);
+    pairs.read_batch(x, pai, n);
+
+    int nb_different = 0;
+    for (int i = 0 ; i < n ; i++)
+    {
+        const Double expected = lut.read(x[i]);
+        if (std::abs(double(out[i] - expected)) > 1.0e-6 || std::abs(double(par[i] - expected)) > 1.0e-6)
+            nb_different++;
+        if (std::abs(double(pai[i] - expected)) > 1.0e-6 || std::abs(double(pairs.read(x[i]) - expected)) > 1.0e-6)
+            nb_different++;
+    }
+    BOOST_CHECK(nb_different == 0);
+
+    // Slopes follow manual changes.
+    LookUpTable<Double> line(NULL, Double(0.0), Double(1.0), 11, "Batch lookup table", NULL, LUT_LAYOUT_INTERLEAVED);
+    for (int i = 0 ; i < 11 ; i++)
+        line.Set(i, Double(2*i));
+    line.Multiply(Double(0.5));
+    BOOST_CHECK(std::abs(double(line.read(Double(0.55)) - Double(5.5))) < 1.0e-5);
+
+    free_me(x, n);
+    free_me(out, n);
+    free_me(par, n);
+    free_me(pai, n);
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(LookUpTableReadBatch)
+{
+    Test_Read_Batch<float>();
+    Test_Read_Batch<double>();
+}
+
+// **************************************************************
+template <class Double>
+static Double Test_Identity(Double x)
+{
+    return x;
+}
+
+// **************************************************************
+static double Test_Identity_Max_Error(const int nb_points)
+{
+    LookUpTable<float> lut(Test_Identity<float>, 0.0f, 1.0f, nb_points, "Identity lookup table");
+
+    // Last point: largest float below xmax, xnorm rounds to n-1.
+    const int n = 100003;
+    float *x   = malloc_and_check<float>(n, "Read batch");
+    float *out = malloc_and_check<float>(n, "Read batch");
+    for (int i = 0 ; i < n ; i++)
+        x[i] = float(i) / float(n);
+    x[n-1] = 0.99999994f;
+    lut.read_batch(x, out, n);
+
+    double max_error = 0.0;
+    for (int i = 0 ; i < n ; i++)
+    {
+        const double error       = std::abs(double(lut.read(x[i])) - double(x[i]));
+        const double batch_error = std::abs(double(out[i]) - double(x[i]));
+        if (error > max_error)
+            max_error = error;
+        if (batch_error > max_error)
+            max_error = batch_error;
+    }
+    free_me(x, n);
+    free_me(out, n);
+    return max_error;
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(LookUpTableFloatAccuracy)
+{
+    // f(x) = x is exact but for rounding: the index and the fraction
+    // within the interval must not drift with the number of points.
+    BOOST_CHECK(Test_Identity_Max_Error(10000) < 1.5e-7);
+    const int n = 1 << 22;
+    BOOST_CHECK(Test_Identity_Max_Error(n) < 0.5 / double(n-1));
+}
+
+// **************************************************************
+template <class Double>
+static Double Test_Cube(Double x)
+{
+    return x*x*x;
+}
+
+// **************************************************************
+template <class Double, int Order>
+static double Test_Max_Error(LookUpTable<Double, Order> &lut)
+{
+    double max_error = 0.0;
+    for (int i = 0 ; i < 100000 ; i++)
+    {
+        const Double x = Double(9.99) * Double(i) / Double(100000);
+        const double error = std::abs(double(lut.read(x)) - std::exp(-double(x)));
+        if (error > max_error)
+            max_error = error;
+    }
+    return max_error;
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(LookUpTableCubic)
+{
+    // 100 times fewer points than the linear table for the same accuracy.
+    LookUpTable<double>    linear(Test_Exp<double>, 0.0, 10.0, 1000000, "Linear lookup table");
+    LookUpTable<double, 3> cubic(Test_Exp<double>, 0.0, 10.0, 10000, "Cubic lookup table");
+    BOOST_CHECK(cubic.Get_Order() == 3);
+    BOOST_CHECK(Test_Max_Error(cubic) < Test_Max_Error(linear));
+
+    // Catmull-Rom tangents are less accurate, but still better than linear.
+    LookUpTable<double>    linear_small(Test_Exp<double>, 0.0, 10.0, 10000, "Linear lookup table");
+    cubic.Set_Tangents(LUT_TANGENTS_CATMULL_ROM);
+    BOOST_CHECK(Test_Max_Error(cubic) < Test_Max_Error(linear_small));
+
+    // Fourth order tangents are exact for a cubic (away from the ends).
+    LookUpTable<double, 3> cube(Test_Cube<double>, 0.0, 1.0, 11, "Cubic lookup table");
+    BOOST_CHECK(std::abs(cube.read(0.55) - 0.55*0.55*0.55) < 1.0e-12);
+    BOOST_CHECK(std::abs(cube.read(0.1)  - 0.001) < 1.0e-12);
+
+    // Coefficients follow manual changes.
+    LookUpTable<float, 3> line(NULL, 0.0f, 1.0f, 11, "Cubic lookup table");
+    for (int i = 0 ; i < 11 ; i++)
+        line.Set(i, float(2*i));
+    line.Multiply(0.5f);
+    BOOST_CHECK(std::abs(line.read(0.55f) - 5.5f) < 1.0e-5f);
+
+    // Batch and single reads agree.
+    LookUpTable<float, 3> cubic_float(Test_Exp<float>, 0.0f, 10.0f, 1000, "Cubic lookup table");
+    const int n = 10007;
+    float *x   = malloc_and_check<float>(n, "Read batch");
+    float *out = malloc_and_check<float>(n, "Read batch");
+    for (int i = 0 ; i < n ; i++)
+        x[i] = 9.99f * float((i * 7919) % n) / float(n);
+    cubic_float.read_batch(x, out, n);
+    int nb_different = 0;
+    for (int i = 0 ; i < n ; i++)
+        if (std::abs(out[i] - cubic_float.read(x[i])) > 1.0e-6f)
+            nb_different++;
+    BOOST_CHECK(nb_different == 0);
+    free_me(x, n);
+    free_me(out, n);
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(LookUpTableTolerance)
+{
+    LookUpTable<double> linear;
+    BOOST_CHECK(linear.Initialize_To_Tolerance(Test_Exp<double>, 0.0, 10.0, 1.0e-8, 0.0, "Tolerance lookup table"));
+    BOOST_CHECK(linear.Get_Measured_Absolute_Error() <= 1.0e-8);
+    BOOST_CHECK(Test_Max_Error(linear) <= 1.0e-8);
+    // Smallest within ~1%: 2% fewer points do not meet the tolerance.
+    LookUpTable<double> smaller(Test_Exp<double>, 0.0, 10.0, linear.Get_n() * 98 / 100, "Tolerance lookup table");
+    BOOST_CHECK(smaller.Measure_Error(1.0e-8, 0.0) > 1.0);
+
+    // Same tolerance with far fewer cubic points.
+    LookUpTable<double, 3> cubic;
+    BOOST_CHECK(cubic.Initialize_To_Tolerance(Test_Exp<double>, 0.0, 10.0, 1.0e-8, 0.0, "Tolerance lookup table"));
+    BOOST_CHECK(cubic.Get_n() * 10 < linear.Get_n());
+
+    // Relative tolerance: exp(-x) gets small, the table needs more points.
+    LookUpTable<double, 3> relative;
+    BOOST_CHECK(relative.Initialize_To_Tolerance(Test_Exp<double>, 0.0, 10.0, 0.0, 1.0e-8, "Tolerance lookup table"));
+    BOOST_CHECK(relative.Get_Measured_Relative_Error() <= 1.0e-8);
+
+    // Not reachable with the allowed number of points.
+    LookUpTable<float> limited;
+    BOOST_CHECK(!limited.Initialize_To_Tolerance(Test_Exp<float>, 0.0f, 10.0f, 1.0e-8, 0.0, "Tolerance lookup table", LUT_LAYOUT_VALUES, 1000));
+    BOOST_CHECK(limited.Get_n() == 1000);
+}
+
+// **************************************************************
+template <class Double>
+static Double Test_Inverse(Double x)
+{
+    return Double(1.0) / x;
+}
+
+// **************************************************************
+BOOST_AUTO_TEST_CASE(SegmentedLookUpTable)
+{
+    BOOST_CHECK(LUT_Exponent(1.0) == 0 && LUT_Exponent(0.75) == -1 && LUT_Exponent(5.0f) == 2);
+
+    // One segment per octave; xmax (excluded) does not start one.
+    Segmented_LookUpTable<double> octaves;
+    octaves.Initialize(Test_Inverse<double>, 0.5, 4.0, 100, "Segmented lookup table");
+    BOOST_CHECK(octaves.Get_Nb_Segments() == 3);
+    BOOST_CHECK(octaves.Get_n() == 300);
+    BOOST_CHECK(std::abs(octaves.read(3.0) - 1.0/3.0) < 1.0e-4);
+
+    // 1/r: fine points only where it is steep.
+    Segmented_LookUpTable<double> segmented;
+    BOOST_CHECK(segmented.Initialize_To_Tolerance(Test_Inverse<double>, 0.1, 100.0, 0.0, 1.0e-6, "Segmented lookup table"));
+    LookUpTable<double> uniform;
+    BOOST_CHECK(uniform.Initialize_To_Tolerance(Test_Inverse<double>, 0.1, 100.0, 0.0, 1.0e-6, "Segmented lookup table"));
+    BOOST_CHECK(segmented.Get_n() * 50 < uniform.Get_n());
+
+    // Reads just below the segments' ends, and batch reads.
+    const int n = 10007;
+    double *x   = malloc_and_check<double>(n, "Read batch");
+    double *out = malloc_and_check<double>(n, "Read batch");
+    for (int i = 0 ; i < n ; i++)
+        x[i] = 0.1 + 99.8 * double(i) / double(n);
+    x[0] = 1.0 - 1.0e-16;
+    x[1] = 64.0 - 1.0e-14;
+    segmented.read_batch(x, out, n);
+    int nb_different = 0;
+    for (int i = 0 ; i < n ; i++)
+    {
+        const double read = segmented.read(x[i]);
+        if (std::abs(out[i] - read) > 1.0e-15 || std::abs(read * x[i] - 1.0) > 1.0e-6)
+            nb_different++;
+    }
+    BOOST_CHECK(nb_different == 0);
+    free_me(x, n);
+    free_me(out, n);
+}